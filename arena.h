@@ -0,0 +1,256 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/* Output buffers for the -t and -b benchmarks, mapped explicitly so
+ * that page size, NUMA placement and first-touch faults are decided
+ * before any timing starts rather than by whichever generator happens
+ * to write a page first.
+ *
+ * Pages come in four kinds. Plain 4 KiB pages, transparent huge pages
+ * requested with madvise(MADV_HUGEPAGE) on a 2 MiB aligned range, and
+ * explicit 2 MiB or 1 GiB hugetlbfs pages, which must be reserved by
+ * the administrator (vm.nr_hugepages, or the per-size knobs under
+ * /sys/kernel/mm/hugepages) or the mapping fails.
+ *
+ * A memory policy is applied with mbind(2) before the range is faulted
+ * in, binding it to one node or interleaving it across all of them.
+ * This is done with the raw system call so there is no dependency on
+ * libnuma. The NUMA topology is read from sysfs, and a machine without
+ * /sys/devices/system/node is treated as a single node 0.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#ifndef MAP_HUGE_SHIFT
+#  define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#  define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#  define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MADV_POPULATE_WRITE
+#  define MADV_POPULATE_WRITE 23
+#endif
+
+#define ARENA_MAXNODES 1024  /* Bits in an mbind(2) node mask */
+#define ARENA_ANY        -1  /* No policy, pages land where first touched */
+#define ARENA_INTERLEAVE -2  /* Interleave pages across every node */
+
+enum arena_pages {
+    ARENA_4K,
+    ARENA_THP,
+    ARENA_2M,
+    ARENA_1G,
+    ARENA_PAGES
+};
+
+static const char arena_pages_name[ARENA_PAGES][4] = {
+    "4k", "thp", "2m", "1g"
+};
+
+static const size_t arena_page_size[ARENA_PAGES] = {
+    4UL << 10, 2UL << 20, 2UL << 20, 1UL << 30
+};
+
+struct arena {
+    void *base;
+    size_t size;
+    enum arena_pages pages;
+    void *map;              /* What to munmap(), before alignment */
+    size_t len;
+};
+
+/* Parse a sysfs CPU or node list such as "0-3,8-11" into set. Returns
+ * 0 if the file cannot be read.
+ */
+static int
+arena_list(const char *path, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    int lo, hi, c;
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if ((c = fgetc(f)) == '-') {
+            if (fscanf(f, "%d", &hi) != 1)
+                break;
+            c = fgetc(f);
+        }
+        for (int i = lo; i <= hi && i < CPU_SETSIZE; i++)
+            CPU_SET(i, set);
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return 1;
+}
+
+/* Online NUMA nodes, or just node 0 without sysfs. */
+static void
+arena_nodes(cpu_set_t *nodes)
+{
+    if (!arena_list("/sys/devices/system/node/online", nodes) ||
+            !CPU_COUNT(nodes)) {
+        CPU_ZERO(nodes);
+        CPU_SET(0, nodes);
+    }
+}
+
+/* CPUs belonging to a node. Without sysfs node 0 owns every CPU. */
+static void
+arena_node_cpus(int node, cpu_set_t *cpus)
+{
+    char path[64];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/node/node%d/cpulist", node);
+    if (!arena_list(path, cpus) && !node)
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            CPU_SET(i, cpus);
+}
+
+/* The node a CPU belongs to, defaulting to node 0. */
+static int
+arena_cpu_node(int cpu)
+{
+    cpu_set_t nodes, cpus;
+    arena_nodes(&nodes);
+    for (int n = 0; n < CPU_SETSIZE; n++) {
+        if (!CPU_ISSET(n, &nodes))
+            continue;
+        arena_node_cpus(n, &cpus);
+        if (CPU_ISSET(cpu, &cpus))
+            return n;
+    }
+    return 0;
+}
+
+#define ARENA_MASKBITS (8 * sizeof(unsigned long))
+
+/* Apply the policy for node (a node number, ARENA_ANY or
+ * ARENA_INTERLEAVE) to the pages starting in [offset, offset + len).
+ * A page straddling two ranges goes with the one it starts in. Call
+ * before arena_fault(), as the policy only steers new pages. Returns 0
+ * with errno set on failure.
+ */
+static int
+arena_bind(struct arena *a, size_t offset, size_t len, int node)
+{
+    size_t page = arena_page_size[a->pages];
+    size_t lo = (offset + page - 1) & ~(page - 1);
+    size_t hi = (offset + len + page - 1) & ~(page - 1);
+    if (node == ARENA_ANY || lo >= hi)
+        return 1;
+    unsigned long mask[ARENA_MAXNODES / ARENA_MASKBITS];
+    memset(mask, 0, sizeof(mask));
+    int mode = MPOL_BIND;
+    if (node == ARENA_INTERLEAVE) {
+        cpu_set_t nodes;
+        arena_nodes(&nodes);
+        for (int n = 0; n < ARENA_MAXNODES && n < CPU_SETSIZE; n++)
+            if (CPU_ISSET(n, &nodes))
+                mask[n / ARENA_MASKBITS] |= 1UL << n % ARENA_MASKBITS;
+        mode = MPOL_INTERLEAVE;
+    } else if (node >= 0 && node < ARENA_MAXNODES) {
+        mask[node / ARENA_MASKBITS] |= 1UL << node % ARENA_MASKBITS;
+    } else {
+        errno = EINVAL;
+        return 0;
+    }
+    /* The kernel counts one more bit than it reads */
+    return !syscall(SYS_mbind, (char *)a->base + lo, hi - lo, mode,
+                    mask, ARENA_MAXNODES + 1, 0);
+}
+
+/* Map at least size bytes of the given page kind without faulting any
+ * of it in. Returns 0 with errno set on failure, typically ENOMEM when
+ * too few hugetlbfs pages are reserved.
+ */
+static int
+arena_map(struct arena *a, size_t size, enum arena_pages pages)
+{
+    size_t page = arena_page_size[pages];
+    size_t len = (size + page - 1) & ~(page - 1);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (pages == ARENA_THP)
+        len += page;  /* Room to align to a huge page boundary */
+    else if (pages == ARENA_2M)
+        flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    else if (pages == ARENA_1G)
+        flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+
+    a->map = mmap(0, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (a->map == MAP_FAILED)
+        return 0;
+    a->len = len;
+    a->base = a->map;
+    a->size = (size + page - 1) & ~(page - 1);
+    a->pages = pages;
+
+    /* Keep 4k honest when THP is "always", and ask for THP otherwise */
+    int advice = MADV_NOHUGEPAGE;
+    if (pages == ARENA_THP) {
+        uintptr_t p = ((uintptr_t)a->map + page - 1) & ~(page - 1);
+        a->base = (void *)p;
+        advice = MADV_HUGEPAGE;
+    }
+    if (pages <= ARENA_THP && madvise(a->base, a->size, advice)) {
+        int err = errno;
+        munmap(a->map, a->len);
+        errno = err;
+        return 0;
+    }
+    return 1;
+}
+
+/* Fault every page in now, writing so nothing is left copy-on-write.
+ * MADV_POPULATE_WRITE reports a short hugetlb pool as an error where
+ * touching the pages would raise SIGBUS. Kernels before 5.14 lack it.
+ * Returns 0 with errno set on failure.
+ */
+static int
+arena_fault(struct arena *a)
+{
+    if (!madvise(a->base, a->size, MADV_POPULATE_WRITE))
+        return 1;
+    if (errno != EINVAL || a->pages >= ARENA_2M)
+        return 0;
+    for (size_t i = 0; i < a->size; i += arena_page_size[ARENA_4K])
+        ((volatile char *)a->base)[i] = 0;
+    return 1;
+}
+
+static void
+arena_free(struct arena *a)
+{
+    munmap(a->map, a->len);
+    a->map = a->base = 0;
+}
+
+/* Map, bind the whole range to node, and fault it in. */
+static int
+arena_alloc(struct arena *a, size_t size, enum arena_pages pages, int node)
+{
+    if (!arena_map(a, size, pages))
+        return 0;
+    if (!arena_bind(a, 0, a->size, node) || !arena_fault(a)) {
+        int err = errno;
+        arena_free(a);
+        errno = err;
+        return 0;
+    }
+    return 1;
+}
+
+#endif
@@ -1,6 +1,12 @@
 #include <string.h>
 #include <assert.h>
 #include "blowfish.h"
+#include "isa.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define BLOWFISH_X86 1
+#endif
 
 static const uint32_t blowfish_p[] = {
     0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344,
@@ -312,6 +318,195 @@ blowfish_encrypt4(struct blowfish *ctx, uint32_t *bl, uint32_t *br)
     *br = xl;
 }
 
+#define BLOWFISH_BATCH 8
+
+/* Encrypt BLOWFISH_BATCH consecutive counters with interleaved rounds,
+ * so the S-box lookups of independent blocks overlap.
+ */
+static void
+blowfish_ctr_scalar(struct blowfish *ctx, int rounds, uint64_t ctr,
+                    uint64_t *out, size_t n)
+{
+    size_t k = 0;
+    for (; k + BLOWFISH_BATCH <= n; k += BLOWFISH_BATCH) {
+        uint32_t xl[BLOWFISH_BATCH];
+        uint32_t xr[BLOWFISH_BATCH];
+        for (int j = 0; j < BLOWFISH_BATCH; j++) {
+            uint64_t c = ctr + k + j;
+            xl[j] = c >> 32;
+            xr[j] = c;
+        }
+        for (int i = 0; i < rounds; i += 2) {
+            for (int j = 0; j < BLOWFISH_BATCH; j++) {
+                xl[j] ^= ctx->p[i];
+                xr[j] ^= blowfish_f(ctx->s, xl[j]);
+                xr[j] ^= ctx->p[i + 1];
+                xl[j] ^= blowfish_f(ctx->s, xr[j]);
+            }
+        }
+        for (int j = 0; j < BLOWFISH_BATCH; j++) {
+            xl[j] ^= ctx->p[16];
+            xr[j] ^= ctx->p[17];
+            out[k + j] = (uint64_t)xl[j] << 32 | xr[j];
+        }
+    }
+    for (; k < n; k++) {
+        uint64_t c = ctr + k;
+        uint32_t xl = c >> 32;
+        uint32_t xr = c;
+        for (int i = 0; i < rounds; i += 2) {
+            xl ^= ctx->p[i];
+            xr ^= blowfish_f(ctx->s, xl);
+            xr ^= ctx->p[i + 1];
+            xl ^= blowfish_f(ctx->s, xr);
+        }
+        xl ^= ctx->p[16];
+        xr ^= ctx->p[17];
+        out[k] = (uint64_t)xl << 32 | xr;
+    }
+}
+
+#ifdef BLOWFISH_X86
+/* The vector kernels fall back to the scalar kernel for batches where
+ * the low counter word would wrap, and for the tail.
+ */
+__attribute__((target("avx2")))
+static __m256i
+blowfish_f_avx2(const struct blowfish *ctx, __m256i x)
+{
+    const int *s = (const int *)ctx->s;
+    __m256i b = _mm256_set1_epi32(0xff);
+    __m256i i0 = _mm256_srli_epi32(x, 24);
+    __m256i i1 = _mm256_and_si256(_mm256_srli_epi32(x, 16), b);
+    __m256i i2 = _mm256_and_si256(_mm256_srli_epi32(x,  8), b);
+    __m256i i3 = _mm256_and_si256(x, b);
+    __m256i a = _mm256_i32gather_epi32(s + 0x000, i0, 4);
+    __m256i c = _mm256_i32gather_epi32(s + 0x100, i1, 4);
+    __m256i d = _mm256_i32gather_epi32(s + 0x200, i2, 4);
+    __m256i e = _mm256_i32gather_epi32(s + 0x300, i3, 4);
+    a = _mm256_add_epi32(a, c);
+    return _mm256_add_epi32(_mm256_xor_si256(a, d), e);
+}
+
+__attribute__((target("avx2")))
+static void
+blowfish_ctr_avx2(struct blowfish *ctx, int rounds, uint64_t ctr,
+                  uint64_t *out, size_t n)
+{
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        uint64_t c = ctr + k;
+        if ((uint32_t)c > UINT32_MAX - 7) {
+            blowfish_ctr_scalar(ctx, rounds, c, out + k, 8);
+            continue;
+        }
+        __m256i xl = _mm256_set1_epi32(c >> 32);
+        __m256i xr = _mm256_add_epi32(_mm256_set1_epi32(c), lane);
+        for (int i = 0; i < rounds; i += 2) {
+            xl = _mm256_xor_si256(xl, _mm256_set1_epi32(ctx->p[i]));
+            xr = _mm256_xor_si256(xr, blowfish_f_avx2(ctx, xl));
+            xr = _mm256_xor_si256(xr, _mm256_set1_epi32(ctx->p[i + 1]));
+            xl = _mm256_xor_si256(xl, blowfish_f_avx2(ctx, xr));
+        }
+        xl = _mm256_xor_si256(xl, _mm256_set1_epi32(ctx->p[16]));
+        xr = _mm256_xor_si256(xr, _mm256_set1_epi32(ctx->p[17]));
+        __m256i lo = _mm256_unpacklo_epi32(xr, xl);
+        __m256i hi = _mm256_unpackhi_epi32(xr, xl);
+        _mm256_storeu_si256((void *)(out + k + 0),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((void *)(out + k + 4),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    blowfish_ctr_scalar(ctx, rounds, ctr + k, out + k, n - k);
+}
+
+__attribute__((target("avx512f")))
+static __m512i
+blowfish_f_avx512(const struct blowfish *ctx, __m512i x)
+{
+    const int *s = (const int *)ctx->s;
+    __m512i b = _mm512_set1_epi32(0xff);
+    __m512i i0 = _mm512_srli_epi32(x, 24);
+    __m512i i1 = _mm512_and_si512(_mm512_srli_epi32(x, 16), b);
+    __m512i i2 = _mm512_and_si512(_mm512_srli_epi32(x,  8), b);
+    __m512i i3 = _mm512_and_si512(x, b);
+    __m512i a = _mm512_i32gather_epi32(i0, s + 0x000, 4);
+    __m512i c = _mm512_i32gather_epi32(i1, s + 0x100, 4);
+    __m512i d = _mm512_i32gather_epi32(i2, s + 0x200, 4);
+    __m512i e = _mm512_i32gather_epi32(i3, s + 0x300, 4);
+    a = _mm512_add_epi32(a, c);
+    return _mm512_add_epi32(_mm512_xor_si512(a, d), e);
+}
+
+__attribute__((target("avx512f")))
+static void
+blowfish_ctr_avx512(struct blowfish *ctx, int rounds, uint64_t ctr,
+                    uint64_t *out, size_t n)
+{
+    __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                     8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i ilo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19,
+                                    4, 20, 5, 21, 6, 22, 7, 23);
+    __m512i ihi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27,
+                                    12, 28, 13, 29, 14, 30, 15, 31);
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        uint64_t c = ctr + k;
+        if ((uint32_t)c > UINT32_MAX - 15) {
+            blowfish_ctr_scalar(ctx, rounds, c, out + k, 16);
+            continue;
+        }
+        __m512i xl = _mm512_set1_epi32(c >> 32);
+        __m512i xr = _mm512_add_epi32(_mm512_set1_epi32(c), lane);
+        for (int i = 0; i < rounds; i += 2) {
+            xl = _mm512_xor_si512(xl, _mm512_set1_epi32(ctx->p[i]));
+            xr = _mm512_xor_si512(xr, blowfish_f_avx512(ctx, xl));
+            xr = _mm512_xor_si512(xr, _mm512_set1_epi32(ctx->p[i + 1]));
+            xl = _mm512_xor_si512(xl, blowfish_f_avx512(ctx, xr));
+        }
+        xl = _mm512_xor_si512(xl, _mm512_set1_epi32(ctx->p[16]));
+        xr = _mm512_xor_si512(xr, _mm512_set1_epi32(ctx->p[17]));
+        __m512i lo = _mm512_permutex2var_epi32(xr, ilo, xl);
+        __m512i hi = _mm512_permutex2var_epi32(xr, ihi, xl);
+        _mm512_storeu_si512(out + k + 0, lo);
+        _mm512_storeu_si512(out + k + 8, hi);
+    }
+    blowfish_ctr_scalar(ctx, rounds, ctr + k, out + k, n - k);
+}
+#endif
+
+typedef void (*blowfish_ctr_fn)(struct blowfish *, int, uint64_t,
+                                uint64_t *, size_t);
+
+/* Chosen on every call rather than cached in a static, which worker
+ * threads would race to fill. __builtin_cpu_supports() only tests bits
+ * already read by cpuid, which is nothing next to a batch of rounds.
+ */
+static blowfish_ctr_fn
+blowfish_ctr_select(void)
+{
+#ifdef BLOWFISH_X86
+    if (ISA_AVX512 && __builtin_cpu_supports("avx512f"))
+        return blowfish_ctr_avx512;
+    if (ISA_AVX2 && __builtin_cpu_supports("avx2"))
+        return blowfish_ctr_avx2;
+#endif
+    return blowfish_ctr_scalar;
+}
+
+void
+blowfish_ctr16(struct blowfish *ctx, uint64_t ctr, uint64_t *out, size_t n)
+{
+    blowfish_ctr_select()(ctx, 16, ctr, out, n);
+}
+
+void
+blowfish_ctr4(struct blowfish *ctx, uint64_t ctr, uint64_t *out, size_t n)
+{
+    blowfish_ctr_select()(ctx, 4, ctr, out, n);
+}
+
 static void
 blowfish_expand(struct blowfish *ctx, const void *key, int len)
 {
@@ -348,3 +543,227 @@ blowfish_init(struct blowfish *ctx, const void *key, int len)
     memcpy(ctx->p, blowfish_p, sizeof(blowfish_p));
     blowfish_expand(ctx, key, len);
 }
+
+/* Batch key setup. A key schedule is one long dependency chain: each
+ * of its 521 encryptions reads the subkeys written by the last. Only
+ * independent schedules can overlap, so the batch kernels run several
+ * contexts in lockstep, each step encrypting one block per context and
+ * storing it as the next two subkey words. The P-array and S-boxes are
+ * contiguous, so step w writes word w of the 1042-word schedule.
+ */
+#define BLOWFISH_WORDS (18 + 4 * 256)
+#define BLOWFISH_GROUP 16  /* Contexts prepared, then expanded, at a time */
+
+static uint32_t *
+blowfish_word(struct blowfish *ctx, int w)
+{
+    return w < 18 ? ctx->p + w : ctx->s[(w - 18) >> 8] + ((w - 18) & 0xff);
+}
+
+/* Reset the subkeys and mix in each context's key, as blowfish_init(). */
+static void
+blowfish_prepare(struct blowfish *ctx, const uint8_t *keys, int len,
+                 size_t n)
+{
+    for (size_t j = 0; j < n; j++) {
+        memcpy(ctx[j].s, blowfish_s, sizeof(blowfish_s));
+        memcpy(ctx[j].p, blowfish_p, sizeof(blowfish_p));
+        const uint8_t *k = keys + j * len;
+        for (int i = 0; i < 18; i++) {
+            ctx[j].p[i] ^= (uint32_t)k[(i * 4 + 0) % len] << 24 |
+                           (uint32_t)k[(i * 4 + 1) % len] << 16 |
+                           (uint32_t)k[(i * 4 + 2) % len] <<  8 |
+                           (uint32_t)k[(i * 4 + 3) % len] <<  0;
+        }
+    }
+}
+
+/* Interleaved scalar schedules for up to BLOWFISH_BATCH contexts. */
+static void
+blowfish_expand_scalar(struct blowfish *ctx, size_t n)
+{
+    uint32_t l[BLOWFISH_BATCH] = {0};
+    uint32_t r[BLOWFISH_BATCH] = {0};
+    for (int w = 0; w < BLOWFISH_WORDS; w += 2) {
+        for (int i = 0; i < 16; i += 2) {
+            for (size_t j = 0; j < n; j++) {
+                l[j] ^= ctx[j].p[i];
+                r[j] ^= blowfish_f(ctx[j].s, l[j]);
+                r[j] ^= ctx[j].p[i + 1];
+                l[j] ^= blowfish_f(ctx[j].s, r[j]);
+            }
+        }
+        for (size_t j = 0; j < n; j++) {
+            uint32_t xl = l[j] ^ ctx[j].p[16];
+            uint32_t xr = r[j] ^ ctx[j].p[17];
+            l[j] = xr;
+            r[j] = xl;
+            *blowfish_word(ctx + j, w + 0) = xr;
+            *blowfish_word(ctx + j, w + 1) = xl;
+        }
+    }
+}
+
+static void
+blowfish_expand_batch(struct blowfish *ctx, size_t n)
+{
+    for (size_t k = 0; k < n; k += BLOWFISH_BATCH)
+        blowfish_expand_scalar(ctx + k, n - k < BLOWFISH_BATCH ?
+                                        n - k : BLOWFISH_BATCH);
+}
+
+#ifdef BLOWFISH_X86
+/* One context per lane. Every lookup is a gather from the lane's own
+ * context, addressed in words from ctx[0], so contexts must be adjacent
+ * in one array. The 4168-byte stride also staggers the lanes' S-boxes
+ * across cache sets rather than aliasing them 4 KiB apart.
+ */
+#define BLOWFISH_STRIDE (int)(sizeof(struct blowfish) / 4)
+#define BLOWFISH_S0     (int)(offsetof(struct blowfish, s) / 4)
+
+__attribute__((target("avx2")))
+static __m256i
+blowfish_fx_avx2(const int *base, __m256i lane, __m256i x)
+{
+    __m256i b = _mm256_set1_epi32(0xff);
+    __m256i i0 = _mm256_srli_epi32(x, 24);
+    __m256i i1 = _mm256_and_si256(_mm256_srli_epi32(x, 16), b);
+    __m256i i2 = _mm256_and_si256(_mm256_srli_epi32(x,  8), b);
+    __m256i i3 = _mm256_and_si256(x, b);
+    base += BLOWFISH_S0;
+    __m256i a = _mm256_i32gather_epi32(base + 0x000,
+                                       _mm256_add_epi32(lane, i0), 4);
+    __m256i c = _mm256_i32gather_epi32(base + 0x100,
+                                       _mm256_add_epi32(lane, i1), 4);
+    __m256i d = _mm256_i32gather_epi32(base + 0x200,
+                                       _mm256_add_epi32(lane, i2), 4);
+    __m256i e = _mm256_i32gather_epi32(base + 0x300,
+                                       _mm256_add_epi32(lane, i3), 4);
+    a = _mm256_add_epi32(a, c);
+    return _mm256_add_epi32(_mm256_xor_si256(a, d), e);
+}
+
+__attribute__((target("avx2")))
+static void
+blowfish_expand_avx2(struct blowfish *ctx, size_t n)
+{
+    const int *base = (const int *)ctx;
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8, base += 8 * BLOWFISH_STRIDE) {
+        __m256i lane = _mm256_mullo_epi32(_mm256_set1_epi32(BLOWFISH_STRIDE),
+                       _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i l = _mm256_setzero_si256();
+        __m256i r = _mm256_setzero_si256();
+        for (int w = 0; w < BLOWFISH_WORDS; w += 2) {
+            for (int i = 0; i < 16; i += 2) {
+                __m256i pi = _mm256_i32gather_epi32(base + i, lane, 4);
+                __m256i pj = _mm256_i32gather_epi32(base + i + 1, lane, 4);
+                l = _mm256_xor_si256(l, pi);
+                r = _mm256_xor_si256(r, blowfish_fx_avx2(base, lane, l));
+                r = _mm256_xor_si256(r, pj);
+                l = _mm256_xor_si256(l, blowfish_fx_avx2(base, lane, r));
+            }
+            __m256i xl = _mm256_i32gather_epi32(base + 16, lane, 4);
+            __m256i xr = _mm256_i32gather_epi32(base + 17, lane, 4);
+            xl = _mm256_xor_si256(l, xl);
+            xr = _mm256_xor_si256(r, xr);
+            l = xr;
+            r = xl;
+            uint32_t lo[8], hi[8];
+            _mm256_storeu_si256((void *)lo, xr);
+            _mm256_storeu_si256((void *)hi, xl);
+            for (int j = 0; j < 8; j++) {
+                *blowfish_word(ctx + k + j, w + 0) = lo[j];
+                *blowfish_word(ctx + k + j, w + 1) = hi[j];
+            }
+        }
+    }
+    blowfish_expand_batch(ctx + k, n - k);
+}
+
+__attribute__((target("avx512f")))
+static __m512i
+blowfish_fx_avx512(const int *base, __m512i lane, __m512i x)
+{
+    __m512i b = _mm512_set1_epi32(0xff);
+    __m512i i0 = _mm512_srli_epi32(x, 24);
+    __m512i i1 = _mm512_and_si512(_mm512_srli_epi32(x, 16), b);
+    __m512i i2 = _mm512_and_si512(_mm512_srli_epi32(x,  8), b);
+    __m512i i3 = _mm512_and_si512(x, b);
+    base += BLOWFISH_S0;
+    __m512i a = _mm512_i32gather_epi32(_mm512_add_epi32(lane, i0),
+                                       base + 0x000, 4);
+    __m512i c = _mm512_i32gather_epi32(_mm512_add_epi32(lane, i1),
+                                       base + 0x100, 4);
+    __m512i d = _mm512_i32gather_epi32(_mm512_add_epi32(lane, i2),
+                                       base + 0x200, 4);
+    __m512i e = _mm512_i32gather_epi32(_mm512_add_epi32(lane, i3),
+                                       base + 0x300, 4);
+    a = _mm512_add_epi32(a, c);
+    return _mm512_add_epi32(_mm512_xor_si512(a, d), e);
+}
+
+__attribute__((target("avx512f")))
+static void
+blowfish_expand_avx512(struct blowfish *ctx, size_t n)
+{
+    int *base = (int *)ctx;
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16, base += 16 * BLOWFISH_STRIDE) {
+        __m512i lane = _mm512_mullo_epi32(_mm512_set1_epi32(BLOWFISH_STRIDE),
+                       _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                         8, 9, 10, 11, 12, 13, 14, 15));
+        __m512i l = _mm512_setzero_si512();
+        __m512i r = _mm512_setzero_si512();
+        for (int w = 0; w < BLOWFISH_WORDS; w += 2) {
+            for (int i = 0; i < 16; i += 2) {
+                __m512i pi = _mm512_i32gather_epi32(lane, base + i, 4);
+                __m512i pj = _mm512_i32gather_epi32(lane, base + i + 1, 4);
+                l = _mm512_xor_si512(l, pi);
+                r = _mm512_xor_si512(r, blowfish_fx_avx512(base, lane, l));
+                r = _mm512_xor_si512(r, pj);
+                l = _mm512_xor_si512(l, blowfish_fx_avx512(base, lane, r));
+            }
+            __m512i xl = _mm512_i32gather_epi32(lane, base + 16, 4);
+            __m512i xr = _mm512_i32gather_epi32(lane, base + 17, 4);
+            xl = _mm512_xor_si512(l, xl);
+            xr = _mm512_xor_si512(r, xr);
+            l = xr;
+            r = xl;
+            /* The schedule is contiguous from p[0], so word w is at the
+             * same offset in every lane's context.
+             */
+            _mm512_i32scatter_epi32(base + w + 0, lane, xr, 4);
+            _mm512_i32scatter_epi32(base + w + 1, lane, xl, 4);
+        }
+    }
+    blowfish_expand_batch(ctx + k, n - k);
+}
+#endif
+
+typedef void (*blowfish_expand_fn)(struct blowfish *, size_t);
+
+static blowfish_expand_fn
+blowfish_expand_select(void)
+{
+#ifdef BLOWFISH_X86
+    if (ISA_AVX512 && __builtin_cpu_supports("avx512f"))
+        return blowfish_expand_avx512;
+    if (ISA_AVX2 && __builtin_cpu_supports("avx2"))
+        return blowfish_expand_avx2;
+#endif
+    return blowfish_expand_batch;
+}
+
+void
+blowfish_init_batch(struct blowfish *ctx, const void *keys, int len,
+                    size_t n)
+{
+    blowfish_expand_fn expand_fn = blowfish_expand_select();
+    assert(len > 0 && len <= BLOWFISH_MAX_KEY_LENGTH);
+    for (size_t k = 0; k < n; k += BLOWFISH_GROUP) {
+        size_t m = n - k < BLOWFISH_GROUP ? n - k : BLOWFISH_GROUP;
+        blowfish_prepare(ctx + k, (const uint8_t *)keys + k * len, len, m);
+        expand_fn(ctx + k, m);
+    }
+}
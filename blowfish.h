@@ -5,8 +5,22 @@
 #ifndef BLOWFISH_H
 #define BLOWFISH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* A build with several ISA levels compiles this file once per level,
+ * with the level in each external name. See isa.h.
+ */
+#ifdef SHOOTOUT_ISA
+#  include "isa.h"
+#  define blowfish_init       ISA_NAME(blowfish_init)
+#  define blowfish_init_batch ISA_NAME(blowfish_init_batch)
+#  define blowfish_encrypt16  ISA_NAME(blowfish_encrypt16)
+#  define blowfish_encrypt4   ISA_NAME(blowfish_encrypt4)
+#  define blowfish_ctr16      ISA_NAME(blowfish_ctr16)
+#  define blowfish_ctr4       ISA_NAME(blowfish_ctr4)
+#endif
+
 #define BLOWFISH_BLOCK_LENGTH    8
 #define BLOWFISH_SALT_LENGTH     16
 #define BLOWFISH_DIGEST_LENGTH   24
@@ -26,10 +40,32 @@ struct blowfish {
  */
 void blowfish_init(struct blowfish *, const void *key, int len);
 
+/* Initialize n cipher contexts, keying ctx[i] with the len bytes at
+ * keys + i * len. The result matches n calls to blowfish_init(), but the
+ * independent key schedules are interleaved, across SIMD lanes with
+ * AVX-512 or AVX2 gathers when the CPU supports them, so each key costs
+ * far less than a lone blowfish_init().
+ */
+void blowfish_init_batch(struct blowfish *, const void *keys, int len,
+                         size_t n);
+
 /* Encrypt 16 rounds. */
 void blowfish_encrypt16(struct blowfish *, uint32_t *, uint32_t *);
 
 /* Encrypt 4 rounds. */
 void blowfish_encrypt4(struct blowfish *, uint32_t *, uint32_t *);
 
+/* Counter mode keystream, 16 rounds.
+ *
+ * Encrypts the n counters ctr, ctr + 1, ..., storing one 64-bit word
+ * per counter. Counter c is encrypted as the block (c >> 32, c) and
+ * stored as (right << 32) | left, matching blowfish_encrypt16(). Blocks
+ * are processed in batches with AVX-512 or AVX2 gathers when the CPU
+ * supports them, and as interleaved scalar rounds otherwise.
+ */
+void blowfish_ctr16(struct blowfish *, uint64_t ctr, uint64_t *, size_t n);
+
+/* Counter mode keystream, 4 rounds. */
+void blowfish_ctr4(struct blowfish *, uint64_t ctr, uint64_t *, size_t n);
+
 #endif
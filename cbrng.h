@@ -0,0 +1,376 @@
+#ifndef CBRNG_H
+#define CBRNG_H
+
+/* Counter-based generators: Philox4x64 and Threefry4x64 (Salmon et
+ * al., "Parallel Random Numbers: As Easy as 1, 2, 3", 2011), and
+ * splitmix64 recast in the same form. Each is a keyed function of a
+ * 256-bit counter block returning four words. Blocks are numbered in
+ * the first counter word with the rest zero, so word i of a stream is
+ * word i & 3 of block i >> 2. Any word can be computed on its own from
+ * the key, with no state to store or advance.
+ *
+ * The round counts mirror blowfish16/4: Random123's defaults, 10 for
+ * Philox and 20 for Threefry, and the fewest rounds the authors found
+ * to pass BigCrush, 7 and 13. splitmix64ctr keyed with k produces the
+ * splitmix64 stream whose state starts at k.
+ *
+ * Bulk fills run one block per lane. The kernels are written once with
+ * GCC vector extensions and instantiated for AVX2 (4 lanes) and AVX-512
+ * (8 lanes), with the scalar block function as the fallback. The
+ * implementation is selected at runtime with cpuid.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "isa.h"
+
+#define CBRNG_BLOCK 64     /* Words produced per staging refill */
+#define CBRNG_GROUP 32     /* Words per vector kernel step, all ISAs */
+
+#define PHILOX_M0 UINT64_C(0xd2e7470ee14c6c93)
+#define PHILOX_M1 UINT64_C(0xca5a826395121157)
+#define PHILOX_W0 UINT64_C(0x9e3779b97f4a7c15)
+#define PHILOX_W1 UINT64_C(0xbb67ae8584caa73b)
+
+#define THREEFRY_PARITY UINT64_C(0x1bd11bdaa9fc1a22)
+
+static const int threefry_rot[8][2] = {
+    {14, 16}, {52, 57}, {23, 40}, { 5, 37},
+    {25, 33}, {46, 12}, {58, 22}, {32, 32},
+};
+
+#define CBRNG_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* Philox round function on four words of type T, where MULHILO(a, m,
+ * hi, lo) is a full 64x64-bit multiply for T.
+ */
+#define PHILOX4X64_ROUNDS(T, MULHILO, x0, x1, x2, x3, key, rounds) \
+    do { \
+        uint64_t k0_ = (key)[0]; \
+        uint64_t k1_ = (key)[1]; \
+        for (int r_ = 0; r_ < (rounds); r_++) { \
+            T h0_, l0_, h1_, l1_; \
+            MULHILO(x0, PHILOX_M0, h0_, l0_); \
+            MULHILO(x2, PHILOX_M1, h1_, l1_); \
+            x0 = h1_ ^ x1 ^ k0_; \
+            x1 = l1_; \
+            x2 = h0_ ^ x3 ^ k1_; \
+            x3 = l0_; \
+            k0_ += PHILOX_W0; \
+            k1_ += PHILOX_W1; \
+        } \
+    } while (0)
+
+/* Threefry: key injection every four rounds, Skein's mix otherwise. */
+#define THREEFRY4X64_ROUNDS(x0, x1, x2, x3, key, rounds) \
+    do { \
+        uint64_t ks_[5]; \
+        ks_[4] = THREEFRY_PARITY; \
+        for (int i_ = 0; i_ < 4; i_++) { \
+            ks_[i_] = (key)[i_]; \
+            ks_[4] ^= (key)[i_]; \
+        } \
+        x0 += ks_[0]; \
+        x1 += ks_[1]; \
+        x2 += ks_[2]; \
+        x3 += ks_[3]; \
+        for (int r_ = 0; r_ < (rounds); r_++) { \
+            const int *rot_ = threefry_rot[r_ & 7]; \
+            if (r_ & 1) { \
+                x0 += x3; x3 = CBRNG_ROTL(x3, rot_[0]); x3 ^= x0; \
+                x2 += x1; x1 = CBRNG_ROTL(x1, rot_[1]); x1 ^= x2; \
+            } else { \
+                x0 += x1; x1 = CBRNG_ROTL(x1, rot_[0]); x1 ^= x0; \
+                x2 += x3; x3 = CBRNG_ROTL(x3, rot_[1]); x3 ^= x2; \
+            } \
+            if ((r_ & 3) == 3) { \
+                int s_ = (r_ + 1) >> 2; \
+                x0 += ks_[(s_ + 0) % 5]; \
+                x1 += ks_[(s_ + 1) % 5]; \
+                x2 += ks_[(s_ + 2) % 5]; \
+                x3 += ks_[(s_ + 3) % 5] + s_; \
+            } \
+        } \
+    } while (0)
+
+#define SPLITMIX64_MIX(x) \
+    do { \
+        x ^= x >> 30; \
+        x *= UINT64_C(0xbf58476d1ce4e5b9); \
+        x ^= x >> 27; \
+        x *= UINT64_C(0x94d049bb133111eb); \
+        x ^= x >> 31; \
+    } while (0)
+
+#define CBRNG_MULHILO_SCALAR(a, m, hi, lo) \
+    do { \
+        unsigned __int128 p_ = (unsigned __int128)(a) * (m); \
+        hi = p_ >> 64; \
+        lo = p_; \
+    } while (0)
+
+/* Scalar block functions: x holds the counter block on entry and the
+ * output on return.
+ */
+static inline void
+philox4x64(uint64_t x[4], const uint64_t *key, int rounds)
+{
+    uint64_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+    PHILOX4X64_ROUNDS(uint64_t, CBRNG_MULHILO_SCALAR,
+                      x0, x1, x2, x3, key, rounds);
+    x[0] = x0;
+    x[1] = x1;
+    x[2] = x2;
+    x[3] = x3;
+}
+
+static inline void
+threefry4x64(uint64_t x[4], const uint64_t *key, int rounds)
+{
+    uint64_t x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3];
+    THREEFRY4X64_ROUNDS(x0, x1, x2, x3, key, rounds);
+    x[0] = x0;
+    x[1] = x1;
+    x[2] = x2;
+    x[3] = x3;
+}
+
+static inline void
+splitmix64ctr(uint64_t x[4], const uint64_t *key, int rounds)
+{
+    (void)rounds;
+    uint64_t base = x[0] * 4 + 1;
+    for (int j = 0; j < 4; j++) {
+        uint64_t z = key[0] + (base + j) * UINT64_C(0x9e3779b97f4a7c15);
+        SPLITMIX64_MIX(z);
+        x[j] = z;
+    }
+}
+
+typedef uint64_t cbrng_v4 __attribute__((vector_size(32)));
+typedef uint64_t cbrng_v8 __attribute__((vector_size(64)));
+
+/* The high half comes from four 32x32-bit products, which map to
+ * vpmuludq, since neither AVX2 nor AVX-512 has a 64-bit high multiply.
+ */
+#define CBRNG_MULHILO_VECTOR(a, m, hi, lo) \
+    do { \
+        __typeof__(a) a0_ = (a) & 0xffffffff; \
+        __typeof__(a) a1_ = (a) >> 32; \
+        __typeof__(a) p00_ = a0_ * ((m) & 0xffffffff); \
+        __typeof__(a) p01_ = a0_ * ((m) >> 32); \
+        __typeof__(a) p10_ = a1_ * ((m) & 0xffffffff); \
+        __typeof__(a) p11_ = a1_ * ((m) >> 32); \
+        __typeof__(a) mid_ = (p00_ >> 32) + (p01_ & 0xffffffff) + \
+                             (p10_ & 0xffffffff); \
+        hi = p11_ + (p01_ >> 32) + (p10_ >> 32) + (mid_ >> 32); \
+        lo = p00_ + ((p01_ + p10_) << 32); \
+    } while (0)
+
+/* Write lane j's block to out[4j..4j+3]. */
+#define CBRNG_STORE(V, out, x0, x1, x2, x3) \
+    for (int j_ = 0; j_ < (int)(sizeof(V) / 8); j_++) { \
+        (out)[4 * j_ + 0] = x0[j_]; \
+        (out)[4 * j_ + 1] = x1[j_]; \
+        (out)[4 * j_ + 2] = x2[j_]; \
+        (out)[4 * j_ + 3] = x3[j_]; \
+    }
+
+/* Bulk kernels writing the n words of blocks ctr, ctr + 1, ..., where
+ * n is a multiple of CBRNG_GROUP.
+ */
+#define CBRNG_KERNELS(suffix, V, attr) \
+    attr static inline __attribute__((always_inline)) void \
+    philox4x64_fill_##suffix(const uint64_t *key, int rounds, \
+                             uint64_t ctr, uint64_t *out, size_t n) \
+    { \
+        V lane; \
+        for (int j = 0; j < (int)(sizeof(V) / 8); j++) \
+            lane[j] = j; \
+        for (size_t k = 0; k < n; k += sizeof(V) / 2) { \
+            V x0 = lane + (ctr + k / 4); \
+            V x1 = lane ^ lane, x2 = x1, x3 = x1; \
+            PHILOX4X64_ROUNDS(V, CBRNG_MULHILO_VECTOR, \
+                              x0, x1, x2, x3, key, rounds); \
+            CBRNG_STORE(V, out + k, x0, x1, x2, x3); \
+        } \
+    } \
+\
+    attr static inline __attribute__((always_inline)) void \
+    threefry4x64_fill_##suffix(const uint64_t *key, int rounds, \
+                               uint64_t ctr, uint64_t *out, size_t n) \
+    { \
+        V lane; \
+        for (int j = 0; j < (int)(sizeof(V) / 8); j++) \
+            lane[j] = j; \
+        for (size_t k = 0; k < n; k += sizeof(V) / 2) { \
+            V x0 = lane + (ctr + k / 4); \
+            V x1 = lane ^ lane, x2 = x1, x3 = x1; \
+            THREEFRY4X64_ROUNDS(x0, x1, x2, x3, key, rounds); \
+            CBRNG_STORE(V, out + k, x0, x1, x2, x3); \
+        } \
+    } \
+\
+    attr static inline __attribute__((always_inline)) void \
+    splitmix64ctr_fill_##suffix(const uint64_t *key, int rounds, \
+                                uint64_t ctr, uint64_t *out, size_t n) \
+    { \
+        (void)rounds; \
+        V x; \
+        for (int j = 0; j < (int)(sizeof(V) / 8); j++) \
+            x[j] = key[0] + (ctr * 4 + j + 1) * \
+                            UINT64_C(0x9e3779b97f4a7c15); \
+        uint64_t step = UINT64_C(0x9e3779b97f4a7c15) * (sizeof(V) / 8); \
+        for (size_t k = 0; k < n; k += sizeof(V) / 8) { \
+            V z = x; \
+            SPLITMIX64_MIX(z); \
+            memcpy(out + k, &z, sizeof(V)); \
+            x += step; \
+        } \
+    }
+
+CBRNG_KERNELS(avx2, cbrng_v4, __attribute__((target("avx2"))))
+CBRNG_KERNELS(avx512, cbrng_v8, __attribute__((target("avx512f,avx512dq"))))
+
+typedef void (*cbrng_fill_fn)(const uint64_t *, uint64_t, uint64_t *, size_t);
+
+struct cbrng_engine {
+    char name[16];
+    void (*block)(uint64_t x[4], const uint64_t *key);
+    cbrng_fill_fn scalar;
+    cbrng_fill_fn avx2;
+    cbrng_fill_fn avx512;
+};
+
+/* An engine is a block function at a fixed round count, with the
+ * constant propagated into each kernel so the rounds unroll.
+ */
+#define CBRNG_ENGINE(name, gen, rounds) \
+    static void \
+    name##_block(uint64_t x[4], const uint64_t *key) \
+    { \
+        gen(x, key, rounds); \
+    } \
+\
+    static void \
+    name##_scalar(const uint64_t *key, uint64_t ctr, uint64_t *out, \
+                  size_t n) \
+    { \
+        for (size_t k = 0; k < n; k += 4) { \
+            uint64_t x[4] = {ctr++, 0, 0, 0}; \
+            gen(x, key, rounds); \
+            memcpy(out + k, x, sizeof(x)); \
+        } \
+    } \
+\
+    __attribute__((target("avx2"))) static void \
+    name##_avx2(const uint64_t *key, uint64_t ctr, uint64_t *out, size_t n) \
+    { \
+        gen##_fill_avx2(key, rounds, ctr, out, n); \
+    } \
+\
+    __attribute__((target("avx512f,avx512dq"))) static void \
+    name##_avx512(const uint64_t *key, uint64_t ctr, uint64_t *out, \
+                  size_t n) \
+    { \
+        gen##_fill_avx512(key, rounds, ctr, out, n); \
+    } \
+\
+    static const struct cbrng_engine name##_engine = { \
+        #name, name##_block, name##_scalar, name##_avx2, name##_avx512 \
+    };
+
+CBRNG_ENGINE(philox4x64_10,   philox4x64,    10)
+CBRNG_ENGINE(philox4x64_7,    philox4x64,    7)
+CBRNG_ENGINE(threefry4x64_20, threefry4x64,  20)
+CBRNG_ENGINE(threefry4x64_13, threefry4x64,  13)
+CBRNG_ENGINE(splitmix64ctr,   splitmix64ctr, 0)
+
+static const struct cbrng_engine *const cbrng_engines[] = {
+    &philox4x64_10_engine,
+    &philox4x64_7_engine,
+    &threefry4x64_20_engine,
+    &threefry4x64_13_engine,
+    &splitmix64ctr_engine,
+};
+#define CBRNG_NENGINES \
+    (int)(sizeof(cbrng_engines) / sizeof(*cbrng_engines))
+
+/* A keyed stream positioned at a block counter. The out[] member is a
+ * staging block for callers that consume one word at a time.
+ */
+struct cbrng {
+    uint64_t key[4];
+    uint64_t ctr;                   /* Next block */
+    const struct cbrng_engine *e;
+    cbrng_fill_fn fill;
+    const char *isa;
+    uint64_t out[CBRNG_BLOCK];
+};
+
+/* Key the stream from consecutive splitmix64 outputs of seed, so
+ * splitmix64ctr matches the splitmix64 generator for the same seed.
+ */
+static void
+cbrng_init(struct cbrng *g, const struct cbrng_engine *e, uint64_t seed)
+{
+    memset(g, 0, sizeof(*g));
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += UINT64_C(0x9e3779b97f4a7c15));
+        SPLITMIX64_MIX(z);
+        g->key[i] = z;
+    }
+    g->e = e;
+    if (ISA_AVX512 && __builtin_cpu_supports("avx512f") &&
+            __builtin_cpu_supports("avx512dq")) {
+        g->fill = e->avx512;
+        g->isa = "avx512";
+    } else if (ISA_AVX2 && __builtin_cpu_supports("avx2")) {
+        g->fill = e->avx2;
+        g->isa = "avx2";
+    } else {
+        g->fill = e->scalar;
+        g->isa = "scalar";
+    }
+}
+
+/* Word i of the stream, independent of the current position. */
+static inline uint64_t
+cbrng_at(const struct cbrng *g, uint64_t i)
+{
+    uint64_t x[4] = {i >> 2, 0, 0, 0};
+    g->e->block(x, g->key);
+    return x[i & 3];
+}
+
+/* Write the next n words. Fills start on a block boundary, so the
+ * unused words of a partial final block are skipped.
+ */
+static void
+cbrng_fill(struct cbrng *g, uint64_t *out, size_t n)
+{
+    size_t bulk = n - n % CBRNG_GROUP;
+    g->fill(g->key, g->ctr, out, bulk);
+    g->ctr += bulk / 4;
+    for (size_t k = bulk; k < n; k += 4) {
+        uint64_t x[4] = {g->ctr++, 0, 0, 0};
+        g->e->block(x, g->key);
+        memcpy(out + k, x, (n - k < 4 ? n - k : 4) * sizeof(*x));
+    }
+}
+
+#define CBRNG_INIT(name) \
+    static void \
+    name##_cbrng(struct cbrng *g, uint64_t seed) \
+    { \
+        cbrng_init(g, &name##_engine, seed); \
+    }
+
+CBRNG_INIT(philox4x64_10)
+CBRNG_INIT(philox4x64_7)
+CBRNG_INIT(threefry4x64_20)
+CBRNG_INIT(threefry4x64_13)
+CBRNG_INIT(splitmix64ctr)
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+/* Conversions from raw 64-bit outputs to the values programs actually
+ * draw: bounded integers in [0, n), doubles in [0, 1) and pairs of
+ * floats in [0, 1). Each has a scalar form for one word and a bulk form
+ * that converts a whole block, written so the compiler can vectorize
+ * it.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+enum convert {
+    CONVERT_BOUNDED,   /* Lemire's nearly divisionless [0, n) */
+    CONVERT_DOUBLE53,  /* 53 high bits, multiples of 2^-53 */
+    CONVERT_DOUBLE64,  /* Full precision, down to 2^-64 */
+    CONVERT_FLOATS,    /* Two 24-bit floats per word */
+    CONVERT_COUNT
+};
+
+static const char convert_name[CONVERT_COUNT][12] = {
+    "bounded", "double53", "double64", "floats"
+};
+
+/* Bytes of output per value, for MB/s. */
+static const int convert_size[CONVERT_COUNT] = {8, 8, 8, 4};
+
+/* Draw a value in [0, range) into dst with Lemire's method. The 128-bit
+ * product's high half is the candidate, and the modulo is only computed
+ * when the low half lands in the biased region, which has probability
+ * range / 2^64. rand64 assigns the next raw word to x.
+ */
+#define CONVERT_BOUNDED(rand64, x, range, dst) \
+    do { \
+        unsigned __int128 m_; \
+        rand64(x); \
+        m_ = (unsigned __int128)(x) * (range); \
+        if ((uint64_t)m_ < (range)) { \
+            uint64_t t_ = -(range) % (range); \
+            while ((uint64_t)m_ < t_) { \
+                rand64(x); \
+                m_ = (unsigned __int128)(x) * (range); \
+            } \
+        } \
+        dst = m_ >> 64; \
+    } while (0)
+
+static inline double
+convert_double53(uint64_t x)
+{
+    return (x >> 11) * 0x1p-53;
+}
+
+/* The input as a fraction, rounded down: the leading zeros select the
+ * binade and the bits after the leading one fill the mantissa. Every
+ * double in [2^-12, 1) is reachable. Below 2^-12 fewer than 52 bits
+ * follow the leading one, so each binade down to 2^-64 loses one more
+ * low mantissa bit, which is always zero.
+ */
+static inline double
+convert_double64(uint64_t x)
+{
+    if (!x)
+        return 0;
+    int z = __builtin_clzll(x);
+    uint64_t bits = (uint64_t)(1022 - z) << 52 | (x << z << 1) >> 12;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline void
+convert_floats(uint64_t x, float *a, float *b)
+{
+    *a = (int32_t)(x >> 40) * 0x1p-24f;
+    *b = (int32_t)((uint32_t)x >> 8) * 0x1p-24f;
+}
+
+/* Exact conversion of x < 2^52 without a 64-bit integer convert, which
+ * AVX2 lacks: place x in the mantissa of 2^52 and subtract it back out.
+ */
+static inline double
+convert_u52(uint64_t x)
+{
+    double d;
+    x |= UINT64_C(0x4330000000000000);
+    memcpy(&d, &x, sizeof(d));
+    return d - 0x1p52;
+}
+
+/* Bulk bounded draw. Rejected words are skipped rather than redrawn, so
+ * the output matches the scalar path over the same stream but may be
+ * shorter than the input. Returns the number of values written.
+ */
+static size_t
+convert_bounded_bulk(uint64_t *out, const uint64_t *in, size_t n,
+                     uint64_t range)
+{
+    uint64_t t = -range % range;
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned __int128 m = (unsigned __int128)in[i] * range;
+        out[k] = m >> 64;
+        k += (uint64_t)m >= t;
+    }
+    return k;
+}
+
+static size_t
+convert_double53_bulk(double *out, const uint64_t *in, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint64_t y = in[i] >> 11;
+        out[i] = convert_u52(y >> 32) * 0x1p-21 +
+                 convert_u52(y & 0xffffffff) * 0x1p-53;
+    }
+    return n;
+}
+
+/* The count of leading zeros in convert_double64() has a 64-bit vector
+ * form only from AVX-512CD, so with plain AVX2 the exponent is read
+ * instead from an exact conversion of the top 52 bits, or of all of x
+ * when it is below 2^12, and the mantissa is aligned with per-lane
+ * shifts. Without AVX2 there are no such shifts and the scalar form
+ * is faster.
+ */
+static size_t
+convert_double64_bulk(double *out, const uint64_t *in, size_t n)
+{
+#if defined(__AVX2__) && !defined(__AVX512CD__)
+    for (size_t i = 0; i < n; i++) {
+        uint64_t x = in[i];
+        uint64_t s = -(uint64_t)(x >> 12 != 0) & 12;
+        double d = convert_u52(x >> s);
+        uint64_t e;
+        memcpy(&e, &d, sizeof(e));
+        uint64_t p = (e >> 52) - 1023 + s;  /* floor(log2(x)) */
+        uint64_t z = (63 - p) & 63;
+        uint64_t bits = (p + 959) << 52 | (x << z << 1) >> 12;
+        bits &= -(uint64_t)(x != 0);
+        memcpy(out + i, &bits, sizeof(bits));
+    }
+#else
+    for (size_t i = 0; i < n; i++)
+        out[i] = convert_double64(in[i]);
+#endif
+    return n;
+}
+
+static size_t
+convert_floats_bulk(float *out, const uint64_t *in, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[2 * i + 0] = (int32_t)(in[i] >> 40) * 0x1p-24f;
+        out[2 * i + 1] = (int32_t)((uint32_t)in[i] >> 8) * 0x1p-24f;
+    }
+    return 2 * n;
+}
+
+/* Convert n words to out, which must hold 2n floats or n 64-bit values.
+ * Returns the number of values written.
+ */
+static size_t
+convert_bulk(enum convert c, void *out, const uint64_t *in, size_t n,
+             uint64_t range)
+{
+    switch (c) {
+        case CONVERT_BOUNDED:
+            return convert_bounded_bulk(out, in, n, range);
+        case CONVERT_DOUBLE53:
+            return convert_double53_bulk(out, in, n);
+        case CONVERT_DOUBLE64:
+            return convert_double64_bulk(out, in, n);
+        case CONVERT_FLOATS:
+            return convert_floats_bulk(out, in, n);
+        case CONVERT_COUNT:
+            break;
+    }
+    return 0;
+}
+
+#endif
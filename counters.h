@@ -0,0 +1,198 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+/* Hardware performance counters through perf_event_open(2), for -p.
+ * The events are opened as one group led by the cycle counter, so the
+ * kernel schedules them onto the PMU together and a single read()
+ * returns all of them for the same window. Only user space is counted,
+ * which the default perf_event_paranoid setting of 2 permits.
+ *
+ * Any event the kernel or CPU refuses is left out and reported as
+ * unavailable. If the leader itself cannot be opened (no PMU under a
+ * hypervisor, a stricter paranoid setting, seccomp) every event is,
+ * and the benchmark runs as it would without -p.
+ *
+ * There is no generic event for retired uops, so it is a raw event
+ * chosen by vendor: UOPS_RETIRED.SLOTS (0x02c2) on Intel and Retired
+ * Ops (0xc1) on AMD.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+enum counter {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_UOPS,
+    COUNTER_COUNT
+};
+
+static const char counter_name[COUNTER_COUNT][12] = {
+    "cycles", "instr", "L1D-miss", "br-miss", "uops"
+};
+
+struct counters {
+    int n;                          /* Events open, zero when not counting */
+    int fd[COUNTER_COUNT];          /* -1 where unavailable */
+    uint64_t id[COUNTER_COUNT];
+    double total[COUNTER_COUNT];    /* Accumulated, scaled counts */
+    double words;                   /* Words generated while counting */
+};
+
+/* Fill in the type and config for event e, or return 0 if this CPU has
+ * no known encoding for it.
+ */
+static int
+counter_event(enum counter e, struct perf_event_attr *attr)
+{
+    switch (e) {
+        case COUNTER_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            return 1;
+        case COUNTER_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            return 1;
+        case COUNTER_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D |
+                           PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                           PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+            return 1;
+        case COUNTER_BRANCH_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            return 1;
+        case COUNTER_UOPS:
+            attr->type = PERF_TYPE_RAW;
+#if defined(__x86_64__) || defined(__i386__)
+            if (__builtin_cpu_is("intel")) {
+                attr->config = 0x02c2;
+                return 1;
+            } else if (__builtin_cpu_is("amd")) {
+                attr->config = 0x00c1;
+                return 1;
+            }
+#endif
+            return 0;
+        case COUNTER_COUNT:
+            break;
+    }
+    return 0;
+}
+
+/* Open the counter group on the calling thread. Returns the number of
+ * events available, with errno from the leader when that is zero.
+ */
+static int
+counters_open(struct counters *c)
+{
+    memset(c, 0, sizeof(*c));
+    for (int e = 0; e < COUNTER_COUNT; e++)
+        c->fd[e] = -1;
+    for (int e = 0; e < COUNTER_COUNT; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = !e;  /* Members follow the leader */
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        if (!counter_event(e, &attr))
+            continue;
+        long fd = syscall(SYS_perf_event_open, &attr, 0, -1,
+                          e ? c->fd[COUNTER_CYCLES] : -1, 0);
+        if (fd < 0) {
+            if (!e)
+                return 0;
+            continue;
+        }
+        if (ioctl(fd, PERF_EVENT_IOC_ID, c->id + e) < 0) {
+            close(fd);
+            continue;
+        }
+        c->fd[e] = fd;
+        c->n++;
+    }
+    return c->n;
+}
+
+static void
+counters_close(struct counters *c)
+{
+    for (int e = COUNTER_COUNT - 1; e >= 0; e--)
+        if (c->n && c->fd[e] >= 0)
+            close(c->fd[e]);
+    c->n = 0;
+}
+
+/* Forget the accumulated counts, keeping the group open. */
+static void
+counters_clear(struct counters *c)
+{
+    memset(c->total, 0, sizeof(c->total));
+    c->words = 0;
+}
+
+static void
+counters_start(struct counters *c)
+{
+    if (!c->n)
+        return;
+    int leader = c->fd[COUNTER_CYCLES];
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/* Stop counting and add the window's counts to the totals, crediting
+ * them to the given number of words. Pass zero words to discard the
+ * window, e.g. a calibration run. Counts are scaled up if the group was
+ * multiplexed, and dropped if it never got onto the PMU.
+ */
+static void
+counters_stop(struct counters *c, double words)
+{
+    if (!c->n)
+        return;
+    int leader = c->fd[COUNTER_CYCLES];
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    struct {
+        uint64_t nr;
+        uint64_t enabled;
+        uint64_t running;
+        struct {
+            uint64_t value;
+            uint64_t id;
+        } v[COUNTER_COUNT];
+    } buf;
+    ssize_t len = read(leader, &buf, sizeof(buf));
+    if (len < (ssize_t)(3 * sizeof(uint64_t)) || !words || !buf.running)
+        return;
+    double scale = (double)buf.enabled / buf.running;
+    for (uint64_t i = 0; i < buf.nr && i < COUNTER_COUNT; i++)
+        for (int e = 0; e < COUNTER_COUNT; e++)
+            if (c->fd[e] >= 0 && c->id[e] == buf.v[i].id)
+                c->total[e] += buf.v[i].value * scale;
+    c->words += words;
+}
+
+/* Per-word count of event e, or -1 if it was not counted. */
+static double
+counters_per_word(const struct counters *c, enum counter e)
+{
+    if (!c->n || c->fd[e] < 0 || !c->words)
+        return -1;
+    return c->total[e] / c->words;
+}
+
+#endif
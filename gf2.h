@@ -0,0 +1,133 @@
+#ifndef GF2_H
+#define GF2_H
+
+/* Polynomial arithmetic over GF(2) for jumping F2-linear generators.
+ *
+ * Polynomials are little endian bit arrays: bit i of the array is the
+ * coefficient of x^i. A generator's characteristic polynomial P is
+ * recovered from its own output with Berlekamp-Massey, then the jump
+ * table holds x^(2^k) mod P for every k. Jumping a state ahead 2^k
+ * steps is then J(M)s for J = table[k], evaluated one bit at a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GF2_MAXDEG  1024
+#define GF2_WORDS(d) (((d) + 64) / 64)
+
+struct gf2_jumps {
+    int degree;         /* Degree of the characteristic polynomial */
+    int words;          /* Words per polynomial */
+    uint64_t *poly;     /* poly[k * words]: x^(2^k) mod P, k < degree */
+};
+
+static int
+gf2_bit(const uint64_t *p, int i)
+{
+    return p[i / 64] >> (i % 64) & 1;
+}
+
+/* dst ^= src * x^shift, for src of the given number of words. */
+static void
+gf2_addshift(uint64_t *dst, const uint64_t *src, int words, int shift)
+{
+    int w = shift / 64, b = shift % 64;
+    for (int i = 0; i < words; i++) {
+        dst[i + w] ^= src[i] << b;
+        if (b)
+            dst[i + w + 1] ^= src[i] >> (64 - b);
+    }
+}
+
+/* Return the linear complexity of the n bits in seq, and if c is not
+ * null store the connection polynomial there. The caller provides
+ * GF2_WORDS(n) words for c.
+ */
+static int
+gf2_berlekamp_massey(const uint64_t *seq, int n, uint64_t *c)
+{
+    int words = GF2_WORDS(n);
+    uint64_t *b = calloc(3 * (words + 2), sizeof(*b));
+    if (!b) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t *t = b + words + 2;
+    uint64_t *cc = t + words + 2;
+    cc[0] = b[0] = 1;
+
+    int len = 0, m = -1;
+    for (int i = 0; i < n; i++) {
+        int d = gf2_bit(seq, i);
+        for (int j = 1; j <= len; j++)
+            d ^= gf2_bit(cc, j) & gf2_bit(seq, i - j);
+        if (d) {
+            memcpy(t, cc, words * sizeof(*t));
+            gf2_addshift(cc, b, GF2_WORDS(n - (i - m)), i - m);
+            if (2 * len <= i) {
+                len = i + 1 - len;
+                m = i;
+                memcpy(b, t, words * sizeof(*b));
+            }
+        }
+    }
+
+    if (c)
+        memcpy(c, cc, words * sizeof(*c));
+    free(b);
+    return len;
+}
+
+/* r = a^2 mod p, where a has degree below deg and p has degree deg. */
+static void
+gf2_sqrmod(uint64_t *r, const uint64_t *a, const uint64_t *p, int deg)
+{
+    uint64_t sq[2 * GF2_WORDS(GF2_MAXDEG) + 1] = {0};
+    for (int i = 0; i < deg; i++)
+        if (gf2_bit(a, i))
+            sq[2 * i / 64] |= UINT64_C(1) << (2 * i % 64);
+    for (int i = 2 * deg - 2; i >= deg; i--)
+        if (gf2_bit(sq, i))
+            gf2_addshift(sq, p, GF2_WORDS(deg), i - deg);
+    memcpy(r, sq, GF2_WORDS(deg) * sizeof(*r));
+}
+
+/* Build the jump table for an F2-linear generator from nbits of its
+ * output sequence, which must be at least twice the state size.
+ * Returns 0 if the sequence does not have full linear complexity.
+ */
+static int
+gf2_jumps_init(struct gf2_jumps *j, const uint64_t *seq, int nbits)
+{
+    uint64_t c[GF2_WORDS(2 * GF2_MAXDEG)];
+    if (nbits > 2 * GF2_MAXDEG)
+        return 0;
+    int deg = gf2_berlekamp_massey(seq, nbits, c);
+    if (deg < 2 || 2 * deg > nbits)
+        return 0;
+
+    /* The characteristic polynomial is the reciprocal of the
+     * connection polynomial.
+     */
+    uint64_t p[GF2_WORDS(GF2_MAXDEG)] = {0};
+    for (int i = 0; i <= deg; i++)
+        if (gf2_bit(c, i))
+            p[(deg - i) / 64] |= UINT64_C(1) << ((deg - i) % 64);
+
+    j->degree = deg;
+    j->words = GF2_WORDS(deg);
+    j->poly = calloc((size_t)deg * j->words, sizeof(*j->poly));
+    if (!j->poly) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    j->poly[0] = 2;  /* x^(2^0) = x */
+    for (int k = 1; k < deg; k++)
+        gf2_sqrmod(j->poly + k * j->words,
+                   j->poly + (k - 1) * j->words, p, deg);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/* Entry point of the multi-level build, compiled for baseline x86-64 so
+ * that it runs anywhere. See isa.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "isa.h"
+
+#define ISA_DECLARE(suffix, name) int shootout_main_##suffix(int, char **);
+ISA_LEVELS(ISA_DECLARE)
+
+static int (*const isa_main[ISA_COUNT])(int, char **) = {
+#define ISA_MAIN(suffix, name) shootout_main_##suffix,
+    ISA_LEVELS(ISA_MAIN)
+};
+
+int
+isa_run(int level, int argc, char **argv)
+{
+    if (!isa_supported(level)) {
+        fprintf(stderr, "this CPU cannot run %s code\n", isa_name(level));
+        exit(EXIT_FAILURE);
+    }
+    return isa_main[level](argc, argv);
+}
+
+int
+main(int argc, char **argv)
+{
+    return isa_run(isa_best(), argc, argv);
+}
@@ -0,0 +1,154 @@
+#ifndef ISA_H
+#define ISA_H
+
+/* One binary for every x86-64 ISA level. The Makefile compiles
+ * shootout.c and blowfish.c once per level below, each with that
+ * level's -march and -DSHOOTOUT_ISA=suffix. Every name with external
+ * linkage carries the suffix (ISA_NAME), so the copies link side by
+ * side. isa.c holds the real main(). It runs the copy for the highest
+ * level this CPU supports, and -f asks for a lower one, so one machine
+ * can measure what each extension is worth.
+ *
+ * Without SHOOTOUT_ISA (make native) the program is built once, for
+ * whatever the compiler flags say, and -f is refused.
+ */
+
+#include <string.h>
+
+#define ISA_LEVELS(X) \
+    X(v1,   "x86-64") \
+    X(v2,   "x86-64-v2") \
+    X(bmi2, "x86-64-v2+bmi2") \
+    X(v3,   "x86-64-v3") \
+    X(v4,   "x86-64-v4")
+
+#define ISA_PASTE_(a, b) a##_##b
+#define ISA_PASTE(a, b) ISA_PASTE_(a, b)
+#define ISA_NAME(name) ISA_PASTE(name, SHOOTOUT_ISA)
+
+enum isa {
+#define ISA_ENUM(suffix, name) ISA_##suffix,
+    ISA_LEVELS(ISA_ENUM)
+#undef ISA_ENUM
+    ISA_COUNT
+};
+
+#ifdef SHOOTOUT_ISA
+#  define ISA_THIS ISA_PASTE(ISA, SHOOTOUT_ISA)  /* Level being compiled */
+#else
+#  define ISA_THIS -1
+#endif
+
+/* The explicit SIMD kernels in lanes.h, cbrng.h and blowfish.c are
+ * chosen at runtime with cpuid. In a multi-level build they are also
+ * capped at the level being compiled, so a level forced with -f rules
+ * out the wider kernels along with the compiler's own code generation.
+ */
+#if !defined(SHOOTOUT_ISA) || defined(__AVX2__)
+#  define ISA_AVX2 1
+#else
+#  define ISA_AVX2 0
+#endif
+#if !defined(SHOOTOUT_ISA) || defined(__AVX512F__)
+#  define ISA_AVX512 1
+#else
+#  define ISA_AVX512 0
+#endif
+
+/* A level's -f name and its full name. */
+static inline const char *
+isa_suffix(int level)
+{
+    static const char suffix[ISA_COUNT][8] = {
+#define ISA_SUFFIX(suffix, name) #suffix,
+        ISA_LEVELS(ISA_SUFFIX)
+#undef ISA_SUFFIX
+    };
+    return suffix[level];
+}
+
+static inline const char *
+isa_name(int level)
+{
+    static const char name[ISA_COUNT][16] = {
+#define ISA_STRING(suffix, name) name,
+        ISA_LEVELS(ISA_STRING)
+#undef ISA_STRING
+    };
+    return name[level];
+}
+
+/* Whether this CPU, and the OS for the AVX register state, can run
+ * code built for a level. Each level includes the ones below it.
+ */
+static inline int
+isa_supported(int level)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    switch (level) {
+        case ISA_v4:
+            if (!__builtin_cpu_supports("avx512f") ||
+                    !__builtin_cpu_supports("avx512bw") ||
+                    !__builtin_cpu_supports("avx512cd") ||
+                    !__builtin_cpu_supports("avx512dq") ||
+                    !__builtin_cpu_supports("avx512vl"))
+                return 0;
+            /* Fallthrough */
+        case ISA_v3:
+            if (!__builtin_cpu_supports("avx") ||
+                    !__builtin_cpu_supports("avx2") ||
+                    !__builtin_cpu_supports("bmi") ||
+                    !__builtin_cpu_supports("f16c") ||
+                    !__builtin_cpu_supports("fma") ||
+                    !__builtin_cpu_supports("lzcnt") ||
+                    !__builtin_cpu_supports("movbe"))
+                return 0;
+            /* Fallthrough */
+        case ISA_bmi2:
+            if (!__builtin_cpu_supports("bmi2"))
+                return 0;
+            /* Fallthrough */
+        case ISA_v2:
+            if (!__builtin_cpu_supports("popcnt") ||
+                    !__builtin_cpu_supports("sse3") ||
+                    !__builtin_cpu_supports("ssse3") ||
+                    !__builtin_cpu_supports("sse4.1") ||
+                    !__builtin_cpu_supports("sse4.2"))
+                return 0;
+            /* Fallthrough */
+        case ISA_v1:
+            return 1;
+    }
+    return 0;
+#else
+    return level == ISA_v1;
+#endif
+}
+
+/* The highest level this CPU supports. */
+static inline int
+isa_best(void)
+{
+    int level = ISA_COUNT - 1;
+    while (level > ISA_v1 && !isa_supported(level))
+        level--;
+    return level;
+}
+
+/* Find a level by suffix or name, or return -1. */
+static inline int
+isa_find(const char *arg)
+{
+    for (int i = 0; i < ISA_COUNT; i++)
+        if (!strcmp(arg, isa_suffix(i)) || !strcmp(arg, isa_name(i)))
+            return i;
+    return -1;
+}
+
+/* Run the given level's copy of the program, or exit with a message if
+ * this CPU cannot. Defined in isa.c.
+ */
+int isa_run(int level, int argc, char **argv);
+
+#endif
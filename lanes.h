@@ -0,0 +1,211 @@
+#ifndef LANES_H
+#define LANES_H
+
+/* Interleaved multi-lane variants of xoshiro256, xoroshiro128+ and
+ * splitmix64. Each lane is an independent generator, and the state is
+ * stored word-major (s[word][lane]) so one vector holds the same state
+ * word for every lane. Kernels are written once with GCC vector
+ * extensions and instantiated for AVX2 (4 lanes), AVX-512 (8 lanes)
+ * and the baseline target, which serves as the portable fallback. The
+ * implementation is selected at runtime with cpuid. Each call to fill()
+ * writes n lane-interleaved words to out, where n must be a multiple of
+ * the lane count. The out[] member is a staging block for callers that
+ * consume one word at a time.
+ */
+
+#include <string.h>
+
+#include "isa.h"
+
+#define LANES_MAX   8
+#define LANES_BLOCK 64     /* Words produced per refill */
+
+struct lanes {
+    uint64_t s[4][LANES_MAX];
+    uint64_t out[LANES_BLOCK];
+    void (*fill)(struct lanes *, uint64_t *, size_t);
+    const char *isa;
+    int n;
+};
+
+typedef uint64_t lanes_v4 __attribute__((vector_size(32)));
+typedef uint64_t lanes_v8 __attribute__((vector_size(64)));
+
+#define LANES_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+#define LANES_KERNELS(suffix, V, attr) \
+    attr static void \
+    xoshiro256ss_##suffix(struct lanes *g, uint64_t *out, size_t n) \
+    { \
+        V s0, s1, s2, s3; \
+        memcpy(&s0, g->s[0], sizeof(V)); \
+        memcpy(&s1, g->s[1], sizeof(V)); \
+        memcpy(&s2, g->s[2], sizeof(V)); \
+        memcpy(&s3, g->s[3], sizeof(V)); \
+        for (size_t k = 0; k < n; k += sizeof(V) / 8) { \
+            V x = s1 * 5; \
+            V r = LANES_ROTL(x, 7) * 9; \
+            V t = s1 << 17; \
+            s2 ^= s0; \
+            s3 ^= s1; \
+            s1 ^= s2; \
+            s0 ^= s3; \
+            s2 ^= t; \
+            s3 = LANES_ROTL(s3, 45); \
+            memcpy(out + k, &r, sizeof(V)); \
+        } \
+        memcpy(g->s[0], &s0, sizeof(V)); \
+        memcpy(g->s[1], &s1, sizeof(V)); \
+        memcpy(g->s[2], &s2, sizeof(V)); \
+        memcpy(g->s[3], &s3, sizeof(V)); \
+    } \
+\
+    attr static void \
+    xoshiro256pp_##suffix(struct lanes *g, uint64_t *out, size_t n) \
+    { \
+        V s0, s1, s2, s3; \
+        memcpy(&s0, g->s[0], sizeof(V)); \
+        memcpy(&s1, g->s[1], sizeof(V)); \
+        memcpy(&s2, g->s[2], sizeof(V)); \
+        memcpy(&s3, g->s[3], sizeof(V)); \
+        for (size_t k = 0; k < n; k += sizeof(V) / 8) { \
+            V x = s0 + s3; \
+            V r = LANES_ROTL(x, 23) + s0; \
+            V t = s1 << 17; \
+            s2 ^= s0; \
+            s3 ^= s1; \
+            s1 ^= s2; \
+            s0 ^= s3; \
+            s2 ^= t; \
+            s3 = LANES_ROTL(s3, 45); \
+            memcpy(out + k, &r, sizeof(V)); \
+        } \
+        memcpy(g->s[0], &s0, sizeof(V)); \
+        memcpy(g->s[1], &s1, sizeof(V)); \
+        memcpy(g->s[2], &s2, sizeof(V)); \
+        memcpy(g->s[3], &s3, sizeof(V)); \
+    } \
+\
+    attr static void \
+    xoroshiro128plus_##suffix(struct lanes *g, uint64_t *out, size_t n) \
+    { \
+        V s0, s1; \
+        memcpy(&s0, g->s[0], sizeof(V)); \
+        memcpy(&s1, g->s[1], sizeof(V)); \
+        for (size_t k = 0; k < n; k += sizeof(V) / 8) { \
+            V r = s0 + s1; \
+            s1 ^= s0; \
+            s0 = LANES_ROTL(s0, 24) ^ s1 ^ (s1 << 16); \
+            s1 = LANES_ROTL(s1, 37); \
+            memcpy(out + k, &r, sizeof(V)); \
+        } \
+        memcpy(g->s[0], &s0, sizeof(V)); \
+        memcpy(g->s[1], &s1, sizeof(V)); \
+    } \
+\
+    attr static void \
+    splitmix64_##suffix(struct lanes *g, uint64_t *out, size_t n) \
+    { \
+        V s; \
+        memcpy(&s, g->s[0], sizeof(V)); \
+        uint64_t step = UINT64_C(0x9e3779b97f4a7c15) * (sizeof(V) / 8); \
+        for (size_t k = 0; k < n; k += sizeof(V) / 8) { \
+            V x = (s += step); \
+            x ^= x >> 30; \
+            x *= UINT64_C(0xbf58476d1ce4e5b9); \
+            x ^= x >> 27; \
+            x *= UINT64_C(0x94d049bb133111eb); \
+            x ^= x >> 31; \
+            memcpy(out + k, &x, sizeof(V)); \
+        } \
+        memcpy(g->s[0], &s, sizeof(V)); \
+    }
+
+LANES_KERNELS(x4, lanes_v4, )
+LANES_KERNELS(x8, lanes_v8, )
+LANES_KERNELS(avx2, lanes_v4, __attribute__((target("avx2"))))
+LANES_KERNELS(avx512, lanes_v8, __attribute__((target("avx512f,avx512dq"))))
+
+/* Pick the best kernel for n lanes on this CPU. */
+#define LANES_SELECT(g, name) \
+    do { \
+        if ((g)->n == 8 && ISA_AVX512 && \
+                __builtin_cpu_supports("avx512f") && \
+                __builtin_cpu_supports("avx512dq")) { \
+            (g)->fill = name##_avx512; \
+            (g)->isa = "avx512"; \
+        } else if ((g)->n == 4 && ISA_AVX2 && \
+                __builtin_cpu_supports("avx2")) { \
+            (g)->fill = name##_avx2; \
+            (g)->isa = "avx2"; \
+        } else { \
+            (g)->fill = (g)->n == 8 ? name##_x8 : name##_x4; \
+            (g)->isa = "scalar"; \
+        } \
+    } while (0)
+
+static uint64_t
+lanes_splitmix64(uint64_t *s)
+{
+    uint64_t x = (*s += UINT64_C(0x9e3779b97f4a7c15));
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    x ^= x >> 31;
+    return x;
+}
+
+/* Seed each lane's state words from consecutive splitmix64 outputs. */
+static void
+lanes_seed(struct lanes *g, int n, int words, uint64_t seed)
+{
+    memset(g, 0, sizeof(*g));
+    g->n = n;
+    for (int l = 0; l < n; l++)
+        for (int w = 0; w < words; w++)
+            g->s[w][l] = lanes_splitmix64(&seed);
+}
+
+static void
+xoshiro256ss_lanes(struct lanes *g, int n, uint64_t seed)
+{
+    lanes_seed(g, n, 4, seed);
+    LANES_SELECT(g, xoshiro256ss);
+}
+
+static void
+xoshiro256pp_lanes(struct lanes *g, int n, uint64_t seed)
+{
+    lanes_seed(g, n, 4, seed);
+    LANES_SELECT(g, xoshiro256pp);
+}
+
+static void
+xoroshiro128plus_lanes(struct lanes *g, int n, uint64_t seed)
+{
+    lanes_seed(g, n, 2, seed);
+    LANES_SELECT(g, xoroshiro128plus);
+}
+
+/* Lane l produces scalar outputs l, l+n, l+2n, ..., so the interleaved
+ * output is exactly the scalar splitmix64 sequence for the same seed.
+ * The seed is expanded first, as seed_words() does for the scalar
+ * state, including its retry on an all-zero state.
+ */
+static void
+splitmix64_lanes(struct lanes *g, int n, uint64_t seed)
+{
+    uint64_t s;
+    do
+        s = lanes_splitmix64(&seed);
+    while (!s);
+    memset(g, 0, sizeof(*g));
+    g->n = n;
+    for (int l = 0; l < n; l++)
+        g->s[0][l] = s + (uint64_t)(l + 1 - n) *
+                         UINT64_C(0x9e3779b97f4a7c15);
+    LANES_SELECT(g, splitmix64);
+}
+
+#endif
@@ -23,26 +23,29 @@ struct mt64 {
     int i;
 };
 
+/* Initialize from a complete state, which must not be all zero. */
 static void
-mt_init(struct mt64 *mt, uint64_t seed) {
+mt_load(struct mt64 *mt, const uint64_t v[MT_N])
+{
+    for (int i = 0; i < MT_N; i++)
+        mt->v[i] = v[i];
     mt->i = MT_N;
-    mt->v[0] = seed;
-    for (int i = 1; i < MT_N; i++)
-        mt->v[i] = MT_F * (mt->v[i - 1] ^ (mt->v[i - 1] >> (MT_W - 2))) + i;
 }
- 
-static uint64_t
-mt_rand(struct mt64 *mt)
+
+static void
+mt_regen(struct mt64 *mt)
 {
-    if (mt->i >= MT_N) {
-        for (int i = 0; i < MT_N; i++) {
-            uint64_t x = (mt->v[i] & MT_UM) + (mt->v[(i + 1) % MT_N] & MT_LM);
-            uint64_t xa = (x >> 1) ^ ((x & 1) * MT_A);
-            mt->v[i] = mt->v[(i + MT_M) % MT_N] ^ xa;
-        }
-        mt->i = 0;
+    for (int i = 0; i < MT_N; i++) {
+        uint64_t x = (mt->v[i] & MT_UM) + (mt->v[(i + 1) % MT_N] & MT_LM);
+        uint64_t xa = (x >> 1) ^ ((x & 1) * MT_A);
+        mt->v[i] = mt->v[(i + MT_M) % MT_N] ^ xa;
     }
-    uint64_t y = mt->v[mt->i++];
+    mt->i = 0;
+}
+
+static uint64_t
+mt_temper(uint64_t y)
+{
     y = y ^ ((y >> MT_U) & MT_D);
     y = y ^ ((y << MT_S) & MT_B);
     y = y ^ ((y << MT_T) & MT_C);
@@ -50,4 +53,116 @@ mt_rand(struct mt64 *mt)
     return y;
 }
 
+static uint64_t
+mt_rand(struct mt64 *mt)
+{
+    if (mt->i >= MT_N)
+        mt_regen(mt);
+    return mt_temper(mt->v[mt->i++]);
+}
+
+/* Fill buf with the next n outputs, tempering whole runs at a time. */
+static void
+mt_fill(struct mt64 *mt, uint64_t *buf, size_t n)
+{
+    while (n) {
+        if (mt->i >= MT_N)
+            mt_regen(mt);
+        size_t len = MT_N - mt->i;
+        len = len < n ? len : n;
+        const uint64_t *v = mt->v + mt->i;
+        for (size_t i = 0; i < len; i++)
+            buf[i] = mt_temper(v[i]);
+        mt->i += len;
+        buf += len;
+        n -= len;
+    }
+}
+
+/* Block engine with the same output as mt_rand().
+ *
+ * The state is double buffered: v[k] holds the current block, already
+ * regenerated, and each mtx_block() call tempers it into the output
+ * while regenerating the following block into v[k ^ 1]. Regeneration
+ * is split into segments that need no modulo, and since the buffers do
+ * not alias, every loop is free to vectorize.
+ */
+struct mt64x {
+    uint64_t v[2][MT_N];
+    uint64_t out[MT_N];
+    int k;
+    int i;
+};
+
+static uint64_t
+mt_twist(uint64_t a, uint64_t b)
+{
+    uint64_t x = (a & MT_UM) + (b & MT_LM);
+    return (x >> 1) ^ (-(x & 1) & MT_A);
+}
+
+/* Temper o into out while regenerating the next block into w. */
+static void
+mtx_step(const uint64_t *restrict o, uint64_t *restrict w,
+         uint64_t *restrict out)
+{
+    for (int i = 0; i < MT_N - MT_M; i++) {
+        out[i] = mt_temper(o[i]);
+        w[i] = o[i + MT_M] ^ mt_twist(o[i], o[i + 1]);
+    }
+    for (int i = MT_N - MT_M; i < MT_N - 1; i++) {
+        out[i] = mt_temper(o[i]);
+        w[i] = w[i + MT_M - MT_N] ^ mt_twist(o[i], o[i + 1]);
+    }
+    out[MT_N - 1] = mt_temper(o[MT_N - 1]);
+    w[MT_N - 1] = w[MT_M - 1] ^ mt_twist(o[MT_N - 1], w[0]);
+}
+
+static void
+mtx_load(struct mt64x *mt, const uint64_t v[MT_N])
+{
+    for (int i = 0; i < MT_N; i++)
+        mt->v[1][i] = v[i];
+    mtx_step(mt->v[1], mt->v[0], mt->out);
+    mt->k = 0;
+    mt->i = MT_N;
+}
+
+/* Store the next MT_N outputs in out. */
+static void
+mtx_block(struct mt64x *mt, uint64_t out[MT_N])
+{
+    mtx_step(mt->v[mt->k], mt->v[mt->k ^ 1], out);
+    mt->k ^= 1;
+}
+
+static uint64_t
+mtx_rand(struct mt64x *mt)
+{
+    if (mt->i >= MT_N) {
+        mtx_block(mt, mt->out);
+        mt->i = 0;
+    }
+    return mt->out[mt->i++];
+}
+
+/* Fill buf with the next n outputs. Whole blocks are tempered straight
+ * into buf.
+ */
+static void
+mtx_fill(struct mt64x *mt, uint64_t *buf, size_t n)
+{
+    while (n && mt->i < MT_N) {
+        *buf++ = mt->out[mt->i++];
+        n--;
+    }
+    for (; n >= MT_N; n -= MT_N, buf += MT_N)
+        mtx_block(mt, buf);
+    if (n) {
+        mtx_block(mt, mt->out);
+        memcpy(buf, mt->out, n * sizeof(*buf));
+        mt->i = n;
+    }
+}
+
 #endif
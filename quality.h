@@ -0,0 +1,382 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+/* A fast in-process statistical battery. Each test consumes a fixed
+ * number of 64-bit words, fed to it one block at a time, and reduces
+ * them to a single p-value. Tests are independent, so every (generator,
+ * test) pair can run on its own thread from a fresh generator state.
+ *
+ * p-values near 0 mean the statistic was far too large for a uniform
+ * source. A sound generator gives p-values spread evenly over (0, 1),
+ * so an occasional p < 0.001 is expected across a whole sweep, while
+ * p < 1e-6 is a failure.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gf2.h"
+
+#define QUALITY_BLOCK   1024         /* Words per feed() call */
+#define QUALITY_SUSPECT 1e-3
+#define QUALITY_FAIL    1e-6
+
+struct qtest {
+    void (*feed)(void *, const uint64_t *, size_t);
+    double (*pvalue)(void *);
+    size_t words;                    /* Words consumed, QUALITY_BLOCK multiple */
+    size_t size;                     /* Bytes of zero-initialized test state */
+    const char name[12];
+};
+
+/* Regularized incomplete gamma P(a, x) by series, valid for x < a + 1. */
+static double
+gamma_series(double a, double x)
+{
+    double sum = 1 / a, term = sum;
+    for (int n = 1; n < 10000 && term > sum * 1e-16; n++) {
+        term *= x / (a + n);
+        sum += term;
+    }
+    return sum * exp(a * log(x) - x - lgamma(a));
+}
+
+/* Regularized incomplete gamma Q(a, x) by continued fraction (modified
+ * Lentz), valid for x >= a + 1.
+ */
+static double
+gamma_cfrac(double a, double x)
+{
+    double tiny = 1e-300;
+    double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+    for (int i = 1; i < 10000; i++) {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        d = fabs(d) < tiny ? tiny : d;
+        c = b + an / c;
+        c = fabs(c) < tiny ? tiny : c;
+        d = 1 / d;
+        h *= d * c;
+        if (fabs(d * c - 1) < 1e-16)
+            break;
+    }
+    return h * exp(a * log(x) - x - lgamma(a));
+}
+
+/* Upper tail of the chi-square distribution with df degrees of freedom. */
+static double
+chisq_pvalue(double x, int df)
+{
+    double a = df / 2.0;
+    x /= 2;
+    if (x <= 0)
+        return 1;
+    return x < a + 1 ? 1 - gamma_series(a, x) : gamma_cfrac(a, x);
+}
+
+/* P(X >= k) for X ~ Poisson(lambda). */
+static double
+poisson_pvalue(unsigned long long k, double lambda)
+{
+    if (!k)
+        return 1;
+    return lambda < k + 1.0 ? gamma_series(k, lambda)
+                            : 1 - gamma_cfrac(k, lambda);
+}
+
+/* Pearson's statistic for n cells of observed counts against expected
+ * cell probabilities.
+ */
+static double
+chisq_stat(const unsigned long long *count, const double *prob, int n)
+{
+    unsigned long long total = 0;
+    for (int i = 0; i < n; i++)
+        total += count[i];
+    double x = 0;
+    for (int i = 0; i < n; i++) {
+        double e = total * prob[i];
+        x += (count[i] - e) * (count[i] - e) / e;
+    }
+    return x;
+}
+
+/* Bit frequency: ones in each of the 64 bit positions, as a chi-square
+ * over the per-position z-scores.
+ */
+struct freq {
+    unsigned long long ones[64];
+    unsigned long long n;
+};
+
+static void
+freq_feed(void *arg, const uint64_t *buf, size_t n)
+{
+    struct freq *s = arg;
+    /* Count 8 positions per byte lane, flushing before a lane overflows */
+    for (size_t i = 0; i < n; i += 255) {
+        uint64_t acc[8] = {0};
+        size_t end = i + 255 < n ? i + 255 : n;
+        for (size_t k = i; k < end; k++)
+            for (int b = 0; b < 8; b++)
+                acc[b] += buf[k] >> b & UINT64_C(0x0101010101010101);
+        for (int b = 0; b < 8; b++)
+            for (int j = 0; j < 8; j++)
+                s->ones[8 * j + b] += acc[b] >> (8 * j) & 0xff;
+    }
+    s->n += n;
+}
+
+static double
+freq_pvalue(void *arg)
+{
+    struct freq *s = arg;
+    double x = 0;
+    for (int b = 0; b < 64; b++) {
+        double d = 2.0 * s->ones[b] - s->n;
+        x += d * d / s->n;
+    }
+    return chisq_pvalue(x, 64);
+}
+
+/* Runs: the number of runs of identical bits in the whole stream, low
+ * bit of each word first (NIST SP 800-22 section 2.3).
+ */
+struct runs {
+    unsigned long long ones;
+    unsigned long long flips;
+    unsigned long long n;
+    uint64_t last;
+};
+
+static void
+runs_feed(void *arg, const uint64_t *buf, size_t n)
+{
+    struct runs *s = arg;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t w = buf[i];
+        s->ones += __builtin_popcountll(w);
+        s->flips += __builtin_popcountll((w ^ w >> 1) & ~(UINT64_C(1) << 63));
+        if (s->n || i)
+            s->flips += (s->last ^ w) & 1;
+        s->last = w >> 63;
+    }
+    s->n += n;
+}
+
+static double
+runs_pvalue(void *arg)
+{
+    struct runs *s = arg;
+    double bits = 64.0 * s->n;
+    double pi = s->ones / bits;
+    double v = s->flips + 1.0;
+    double e = 2 * bits * pi * (1 - pi);
+    return erfc(fabs(v - e) / (2 * sqrt(2 * bits) * pi * (1 - pi)));
+}
+
+/* Birthday spacings: BDAY_M birthdays in a year of 2^BDAY_BITS days,
+ * taken from the high bits. The count of repeated spacings over all
+ * repetitions is Poisson with mean reps * m^3 / 4n.
+ */
+#define BDAY_M    (1UL << 18)
+#define BDAY_BITS 52
+#define BDAY_REPS 64
+
+struct bday {
+    uint64_t day[BDAY_M];
+    uint64_t tmp[BDAY_M];
+    size_t count[1 << 13];
+    unsigned long long dups;
+    size_t n;
+};
+
+/* LSD radix sort of BDAY_BITS-bit values, 13 bits per pass. */
+static void
+bday_sort(struct bday *s)
+{
+    uint64_t *src = s->day, *dst = s->tmp;
+    for (int shift = 0; shift < BDAY_BITS; shift += 13) {
+        size_t *count = s->count;
+        memset(count, 0, sizeof(s->count));
+        for (size_t i = 0; i < BDAY_M; i++)
+            count[src[i] >> shift & 0x1fff]++;
+        for (size_t i = 0, sum = 0; i < 1 << 13; i++) {
+            size_t c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < BDAY_M; i++)
+            dst[count[src[i] >> shift & 0x1fff]++] = src[i];
+        uint64_t *t = src;
+        src = dst;
+        dst = t;
+    }
+}
+
+static void
+bday_feed(void *arg, const uint64_t *buf, size_t n)
+{
+    struct bday *s = arg;
+    for (size_t i = 0; i < n; i++) {
+        s->day[s->n++] = buf[i] >> (64 - BDAY_BITS);
+        if (s->n == BDAY_M) {
+            bday_sort(s);
+            for (size_t j = BDAY_M - 1; j > 0; j--)
+                s->day[j] -= s->day[j - 1];
+            bday_sort(s);
+            for (size_t j = 1; j < BDAY_M; j++)
+                s->dups += s->day[j] == s->day[j - 1];
+            s->n = 0;
+        }
+    }
+}
+
+static double
+bday_pvalue(void *arg)
+{
+    struct bday *s = arg;
+    double m = BDAY_M;
+    double lambda = BDAY_REPS * m * m * m / ldexp(4, BDAY_BITS);
+    return poisson_pvalue(s->dups, lambda);
+}
+
+/* Gap: lengths of the gaps between words whose top GAP_BITS are zero,
+ * which are geometric with p = 2^-GAP_BITS. Gaps of GAP_T or longer
+ * share the last cell.
+ */
+#define GAP_BITS 4
+#define GAP_T    63
+
+struct gap {
+    unsigned long long count[GAP_T + 1];
+    unsigned long long len;
+};
+
+static void
+gap_feed(void *arg, const uint64_t *buf, size_t n)
+{
+    struct gap *s = arg;
+    for (size_t i = 0; i < n; i++) {
+        if (buf[i] >> (64 - GAP_BITS)) {
+            s->len++;
+        } else {
+            s->count[s->len < GAP_T ? s->len : GAP_T]++;
+            s->len = 0;
+        }
+    }
+}
+
+static double
+gap_pvalue(void *arg)
+{
+    struct gap *s = arg;
+    double prob[GAP_T + 1];
+    double p = ldexp(1, -GAP_BITS);
+    for (int r = 0; r < GAP_T; r++)
+        prob[r] = p * pow(1 - p, r);
+    prob[GAP_T] = pow(1 - p, GAP_T);
+    return chisq_pvalue(chisq_stat(s->count, prob, GAP_T + 1), GAP_T);
+}
+
+/* Hamming weight dependency: each word's popcount is classed as low
+ * (<= 30), middle or high (>= 34), and non-overlapping tuples of
+ * HWD_LEN consecutive classes are counted, so that any dependency
+ * between the weights of nearby outputs skews the tuple distribution.
+ */
+#define HWD_LEN   4
+#define HWD_CELLS 81    /* 3^HWD_LEN */
+
+struct hwd {
+    unsigned long long count[HWD_CELLS];
+    int tuple;
+    int len;
+};
+
+static void
+hwd_feed(void *arg, const uint64_t *buf, size_t n)
+{
+    struct hwd *s = arg;
+    for (size_t i = 0; i < n; i++) {
+        int w = __builtin_popcountll(buf[i]);
+        s->tuple = s->tuple * 3 + (w > 30) + (w > 33);
+        if (++s->len == HWD_LEN) {
+            s->count[s->tuple]++;
+            s->tuple = s->len = 0;
+        }
+    }
+}
+
+static double
+hwd_pvalue(void *arg)
+{
+    struct hwd *s = arg;
+    double class[3] = {0, 0, 0};
+    for (int w = 0; w <= 64; w++)
+        class[(w > 30) + (w > 33)] += exp(lgamma(65) - lgamma(w + 1) -
+                                          lgamma(65 - w) - 64 * log(2));
+    double prob[HWD_CELLS];
+    for (int t = 0; t < HWD_CELLS; t++) {
+        prob[t] = 1;
+        for (int i = 0, c = t; i < HWD_LEN; i++, c /= 3)
+            prob[t] *= class[c % 3];
+    }
+    return chisq_pvalue(chisq_stat(s->count, prob, HWD_CELLS), HWD_CELLS - 1);
+}
+
+/* Linear complexity of LC_M bit blocks of the lowest output bit, where
+ * F2-linear generators are weakest (NIST SP 800-22 section 2.10). The
+ * Berlekamp-Massey step is shared with the gf2.h jump tables.
+ */
+#define LC_M      1024
+#define LC_BLOCKS 1024
+
+struct lc {
+    uint64_t bits[LC_M / 64];
+    unsigned long long count[7];
+    int n;
+};
+
+static void
+lc_feed(void *arg, const uint64_t *buf, size_t n)
+{
+    struct lc *s = arg;
+    for (size_t i = 0; i < n; i++) {
+        s->bits[s->n / 64] |= (buf[i] & 1) << (s->n % 64);
+        if (++s->n == LC_M) {
+            double mu = LC_M / 2.0 + (9 + (LC_M % 2 ? 1 : -1)) / 36.0 -
+                        (LC_M / 3.0 + 2 / 9.0) / ldexp(1, LC_M);
+            double t = (LC_M % 2 ? -1 : 1) *
+                       (gf2_berlekamp_massey(s->bits, LC_M, 0) - mu) + 2 / 9.0;
+            int c = t <= -2.5 ? 0 : t > 2.5 ? 6 : (int)floor(t + 3.5);
+            s->count[c]++;
+            memset(s->bits, 0, sizeof(s->bits));
+            s->n = 0;
+        }
+    }
+}
+
+static double
+lc_pvalue(void *arg)
+{
+    static const double prob[7] = {
+        0.010417, 0.03125, 0.125, 0.5, 0.25, 0.0625, 0.020833
+    };
+    struct lc *s = arg;
+    return chisq_pvalue(chisq_stat(s->count, prob, 7), 6);
+}
+
+static const struct qtest qtests[] = {
+    {freq_feed, freq_pvalue, 1UL << 24, sizeof(struct freq), "frequency"},
+    {runs_feed, runs_pvalue, 1UL << 26, sizeof(struct runs), "runs"},
+    {bday_feed, bday_pvalue, BDAY_M * BDAY_REPS, sizeof(struct bday),
+     "birthday"},
+    {gap_feed, gap_pvalue, 1UL << 26, sizeof(struct gap), "gap"},
+    {hwd_feed, hwd_pvalue, 1UL << 26, sizeof(struct hwd), "hamming"},
+    {lc_feed, lc_pvalue, LC_M * LC_BLOCKS, sizeof(struct lc), "linear"},
+};
+#define NQTESTS (int)(sizeof(qtests) / sizeof(*qtests))
+
+#endif
@@ -44,4 +44,48 @@ rc4_rand(struct rc4 *rc4, void *buf, size_t len)
     rc4->j = j;
 }
 
+/* Word-at-a-time variant of rc4_rand(), producing the same keystream
+ * on little endian hosts. The indices wrap as uint8_t and stay in
+ * registers for the whole fill, and each 64-bit word is assembled in a
+ * register before a single store.
+ */
+static void
+rc4_fill64(struct rc4 *rc4, uint64_t *buf, size_t n)
+{
+    unsigned char *s = rc4->s;
+    uint8_t i = rc4->i;
+    uint8_t j = rc4->j;
+    for (size_t k = 0; k < n; k++) {
+        uint64_t w = 0;
+        for (int b = 0; b < 8; b++) {
+            uint8_t si = s[++i];
+            j += si;
+            uint8_t sj = s[j];
+            s[i] = sj;
+            s[j] = si;
+            w |= (uint64_t)s[(uint8_t)(si + sj)] << (8 * b);
+        }
+        buf[k] = w;
+    }
+    rc4->i = i;
+    rc4->j = j;
+}
+
+/* Discard the first n bytes of keystream (RC4-drop[n]). */
+static void
+rc4_discard(struct rc4 *rc4, size_t n)
+{
+    unsigned char *s = rc4->s;
+    uint8_t i = rc4->i;
+    uint8_t j = rc4->j;
+    while (n--) {
+        uint8_t si = s[++i];
+        j += si;
+        s[i] = s[j];
+        s[j] = si;
+    }
+    rc4->i = i;
+    rc4->j = j;
+}
+
 #endif
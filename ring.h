@@ -0,0 +1,306 @@
+#ifndef RING_H
+#define RING_H
+
+/* A random number service over POSIX shared memory. A server process
+ * (shootout -r) creates a named object holding one queue per producer
+ * thread, and each producer fills its queue's blocks with a generator's
+ * output. Other processes include this header, attach by name, and
+ * claim whole blocks, so a consumer never needs to set up a generator
+ * of its own.
+ *
+ * Each queue is a bounded single-producer, multi-consumer ring, after
+ * Vyukov's bounded MPMC queue. Every block carries a sequence number
+ * that says whose turn it is. Block i at position pos holds:
+ *
+ *   seq == pos            free, waiting for the producer
+ *   seq == pos + 1        full, waiting for a consumer
+ *   seq == pos + NBLOCKS  consumed, free for the next lap
+ *
+ * A consumer takes a full block by advancing the queue's head with a
+ * compare-and-swap, copies the words out, then hands the block back.
+ * Nothing blocks on a lock. But a consumer that dies between claiming
+ * and releasing a block stalls that queue for good.
+ *
+ * Producers and consumers wait by spinning briefly, then yielding, then
+ * sleeping, so an idle server costs next to nothing.
+ *
+ * Client usage:
+ *
+ *   static struct ring_client c;
+ *   if (!ring_attach(&c, "/prng")) ... errno says why
+ *   uint64_t x = ring_next(&c);       or ring_read(&c, buf, n)
+ *   ring_detach(&c);
+ *
+ * Once the server stops and the queues drain, ring_read() returns short
+ * and ring_next() returns zero with c.stopped set.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define RING_MAGIC   UINT64_C(0x31676e6972676e72)  /* "rngring1" */
+#define RING_WORDS   512   /* Words per block, 4 KiB */
+#define RING_NBLOCKS 64    /* Blocks per queue */
+#define RING_MAXQ    64    /* Upper limit on producers */
+
+struct ring_block {
+    uint64_t seq __attribute__((aligned(64)));
+    uint64_t w[RING_WORDS] __attribute__((aligned(64)));
+};
+
+struct ring_queue {
+    uint64_t head __attribute__((aligned(64)));  /* Next block to claim */
+    uint64_t tail __attribute__((aligned(64)));  /* Next block to fill */
+    struct ring_block b[RING_NBLOCKS];
+};
+
+struct ring {
+    uint64_t magic;
+    uint32_t words;         /* RING_WORDS, checked on attach */
+    uint32_t nblocks;       /* RING_NBLOCKS, checked on attach */
+    uint32_t nqueues;
+    uint32_t live;          /* Cleared when the server stops */
+    char generator[24];     /* Name of the generator being served */
+    struct ring_queue q[] __attribute__((aligned(64)));
+};
+
+static inline size_t
+ring_size(uint32_t nqueues)
+{
+    return sizeof(struct ring) + nqueues * sizeof(struct ring_queue);
+}
+
+/* Back off a little more on each call while waiting on the other side. */
+static inline void
+ring_wait(unsigned *spins)
+{
+    if (*spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (*spins < 128) {
+        sched_yield();
+    } else {
+        struct timespec ts = {0, 50000};
+        nanosleep(&ts, 0);
+    }
+    (*spins)++;
+}
+
+/* Server side */
+
+/* Create and map a ring named name with nqueues queues. Returns null
+ * with errno set on failure, including when the name is already taken.
+ */
+static inline struct ring *
+ring_create(const char *name, uint32_t nqueues, const char *generator)
+{
+    if (!nqueues || nqueues > RING_MAXQ) {
+        errno = EINVAL;
+        return 0;
+    }
+    size_t size = ring_size(nqueues);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+        return 0;
+    if (ftruncate(fd, size)) {
+        int err = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = err;
+        return 0;
+    }
+    struct ring *r = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        int err = errno;
+        shm_unlink(name);
+        errno = err;
+        return 0;
+    }
+    r->words = RING_WORDS;
+    r->nblocks = RING_NBLOCKS;
+    r->nqueues = nqueues;
+    r->live = 1;
+    strncpy(r->generator, generator, sizeof(r->generator) - 1);
+    for (uint32_t i = 0; i < nqueues; i++)
+        for (uint64_t b = 0; b < RING_NBLOCKS; b++)
+            r->q[i].b[b].seq = b;
+    __atomic_store_n(&r->magic, RING_MAGIC, __ATOMIC_RELEASE);
+    return r;
+}
+
+/* Tell producers and consumers the server is stopping. */
+static inline void
+ring_stop(struct ring *r)
+{
+    __atomic_store_n(&r->live, 0, __ATOMIC_RELEASE);
+}
+
+/* Unmap and remove the ring. Attached clients keep their mappings. */
+static inline void
+ring_destroy(struct ring *r, const char *name)
+{
+    munmap(r, ring_size(r->nqueues));
+    shm_unlink(name);
+}
+
+/* Wait for the next free block of queue q and return its words for
+ * filling, or null once the ring has been stopped.
+ */
+static inline uint64_t *
+ring_acquire(struct ring *r, struct ring_queue *q)
+{
+    struct ring_block *b = q->b + q->tail % RING_NBLOCKS;
+    unsigned spins = 0;
+    while (__atomic_load_n(&b->seq, __ATOMIC_ACQUIRE) != q->tail) {
+        if (!__atomic_load_n(&r->live, __ATOMIC_ACQUIRE))
+            return 0;
+        ring_wait(&spins);
+    }
+    return b->w;
+}
+
+/* Hand the block from ring_acquire() to consumers. */
+static inline void
+ring_publish(struct ring_queue *q)
+{
+    struct ring_block *b = q->b + q->tail % RING_NBLOCKS;
+    __atomic_store_n(&b->seq, q->tail + 1, __ATOMIC_RELEASE);
+    q->tail++;
+}
+
+/* Client side */
+
+struct ring_client {
+    struct ring *r;
+    uint32_t queue;         /* Queue to try first on the next claim */
+    uint32_t pos;           /* Next unread word in buf */
+    int stopped;            /* Server stopped and the queues are empty */
+    uint64_t buf[RING_WORDS];
+};
+
+/* Map an existing ring. Returns 0 with errno set on failure. */
+static inline int
+ring_attach(struct ring_client *c, const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct ring)) {
+        close(fd);
+        errno = EINVAL;
+        return 0;
+    }
+    struct ring *r = mmap(0, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED)
+        return 0;
+    if (__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != RING_MAGIC ||
+            r->words != RING_WORDS || r->nblocks != RING_NBLOCKS ||
+            (size_t)st.st_size < ring_size(r->nqueues)) {
+        munmap(r, st.st_size);
+        errno = EINVAL;
+        return 0;
+    }
+    c->r = r;
+    c->queue = 0;
+    c->pos = RING_WORDS;
+    c->stopped = 0;
+    return 1;
+}
+
+static inline void
+ring_detach(struct ring_client *c)
+{
+    munmap(c->r, ring_size(c->r->nqueues));
+    c->r = 0;
+}
+
+/* Try to copy one full block from queue q into buf without waiting. */
+static inline int
+ring_claim(struct ring_queue *q, uint64_t *buf)
+{
+    uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    for (;;) {
+        struct ring_block *b = q->b + pos % RING_NBLOCKS;
+        uint64_t seq = __atomic_load_n(&b->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - (pos + 1));
+        if (diff < 0)
+            return 0;  /* Empty */
+        if (diff > 0) {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+            continue;  /* Another consumer got there first */
+        }
+        if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            memcpy(buf, b->w, sizeof(b->w));
+            __atomic_store_n(&b->seq, pos + RING_NBLOCKS, __ATOMIC_RELEASE);
+            return 1;
+        }
+    }
+}
+
+/* Refill the client's buffer from whichever queue has a block, starting
+ * after the last one used so consumers spread across producers. Waits
+ * while every queue is empty. Returns 0 once the server has stopped and
+ * nothing is left.
+ */
+static inline int
+ring_refill(struct ring_client *c)
+{
+    struct ring *r = c->r;
+    unsigned spins = 0;
+    for (;;) {
+        int live = __atomic_load_n(&r->live, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; i < r->nqueues; i++) {
+            uint32_t k = (c->queue + i) % r->nqueues;
+            if (ring_claim(r->q + k, c->buf)) {
+                c->queue = (k + 1) % r->nqueues;
+                c->pos = 0;
+                return 1;
+            }
+        }
+        if (!live) {
+            c->stopped = 1;
+            return 0;
+        }
+        ring_wait(&spins);
+    }
+}
+
+static inline uint64_t
+ring_next(struct ring_client *c)
+{
+    if (c->pos == RING_WORDS && !ring_refill(c))
+        return 0;
+    return c->buf[c->pos++];
+}
+
+/* Copy n words to out, returning fewer only if the server stopped. */
+static inline size_t
+ring_read(struct ring_client *c, uint64_t *out, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        if (c->pos == RING_WORDS && !ring_refill(c))
+            break;
+        size_t len = RING_WORDS - c->pos;
+        len = len < n - done ? len : n - done;
+        memcpy(out + done, c->buf + c->pos, len * sizeof(*out));
+        c->pos += len;
+        done += len;
+    }
+    return done;
+}
+
+#endif
@@ -1,66 +1,850 @@
-#define _POSIX_SOURCE 1
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
+#include <time.h>
+#include <math.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <unistd.h> // alarm()
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
 
 #include "rc4.h"
 #include "mt64.h"
+#include "gf2.h"
+#include "lanes.h"
+#include "quality.h"
+#include "convert.h"
 #include "blowfish.h"
+#include "ziggurat.h"
+#include "counters.h"
+#include "ring.h"
+#include "cbrng.h"
+#include "arena.h"
+#include "isa.h"
+
+/* In a multi-level build isa.c's main() calls this level's copy */
+#ifdef SHOOTOUT_ISA
+#  define main ISA_NAME(shootout_main)
+#endif
 
 #define UNROLL 8           /* Iterations between alarm checks */
-#define SECONDS 1          /* Seconds spent on each test */
-#define NSAMPLES 8         /* Number of samples per generator */
+#ifndef SECONDS
+#  define SECONDS 1        /* Seconds spent on each test */
+#endif
+#ifndef NSAMPLES
+#  define NSAMPLES 8       /* Number of samples per generator */
+#endif
+#define MAXTHREADS 256     /* Upper limit for -t */
+
+/* Block sizes for -b, roughly L1, L2, L3 and DRAM sized */
+static const size_t blocks[] = {
+    16UL << 10, 256UL << 10, 4UL << 20, 256UL << 20
+};
+static const char blocks_name[][8] = {"16K", "256K", "4M", "256M"};
+#define NBLOCKS (int)(sizeof(blocks) / sizeof(*blocks))
 
-#define N (64UL * 1024 * 1024)
-static volatile uint64_t buffer[N];
+#define N (64UL * 1024 * 1024)  /* Words of output shared by -t workers */
 static volatile sig_atomic_t running;
 
-void
+static void
 alarm_handler(int signum)
 {
     (void)signum;
     running = 0;
 }
 
+/* Monotonic wall clock time in seconds. Large blocks may overrun the
+ * alarm, so block rates are computed from elapsed time.
+ */
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Per-thread context for the -t scaling mode. Each worker owns its own
+ * generator state, seeded from its own seed, and a power-of-two slice
+ * of the output arena.
+ */
+struct worker {
+    pthread_t thread;
+    pthread_barrier_t *start;
+    volatile uint64_t *out;
+    unsigned long long mask;
+    unsigned long long count;
+    uint64_t seed;
+    int cpu;
+};
+
+/* Per-thread context for a ring producer in -r and -a. Each producer
+ * fills its own queue from its own generator state.
+ */
+struct producer {
+    pthread_t thread;
+    struct ring *ring;
+    struct ring_queue *queue;
+    uint64_t seed;
+    unsigned long long blocks;  /* Blocks published */
+};
+
+static void
+worker_pin(struct worker *w)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
 #define XSTR(s) str(s)
 #define STR(s) #s
 
-#define DEFINE_BENCH(name, setup, rand64) \
+/* Output pipeline for pump mode. The generator fills a ring of page
+ * aligned buffers on the calling thread while a writer thread hands
+ * whole buffers to stdout, with vmsplice(2) when stdout is a pipe.
+ *
+ * A spliced buffer is still referenced by the pipe until the reader
+ * consumes it. The pipe is sized to at most one buffer, so once buffer
+ * k has been fully spliced, buffer k-1 has left the pipe and may be
+ * refilled.
+ */
+#define PUMP_SIZE (1UL << 20)  /* Bytes per buffer */
+#define PUMP_NBUF 4            /* Buffers in the ring */
+
+static struct {
+    uint64_t *buf[PUMP_NBUF];
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned long long filled;  /* Buffers handed to the writer */
+    unsigned long long freed;   /* Buffers safe to refill */
+    unsigned long long written; /* Buffers fully output */
+    int splice;                 /* Use vmsplice() rather than write() */
+    int done;                   /* Output failed, usually EPIPE */
+    double start;
+    double genwait;             /* Seconds the generator waited on output */
+    double outwait;             /* Seconds the writer waited on generator */
+} pump;
+
+static int
+pump_output(const uint64_t *buf)
+{
+    const char *p = (const char *)buf;
+    size_t len = PUMP_SIZE;
+    while (len) {
+        ssize_t r;
+        if (pump.splice) {
+            struct iovec iov = {(void *)p, len};
+            r = vmsplice(STDOUT_FILENO, &iov, 1, 0);
+            if (r < 0 && (errno == EBADF || errno == EINVAL)) {
+                pump.splice = 0;
+                continue;
+            }
+        } else {
+            r = write(STDOUT_FILENO, p, len);
+        }
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return 0;
+        p += r;
+        len -= r;
+    }
+    return 1;
+}
+
+static void *
+pump_writer(void *arg)
+{
+    (void)arg;
+    for (unsigned long long k = 0; ; k++) {
+        pthread_mutex_lock(&pump.lock);
+        double start = now();
+        while (pump.filled <= k && !pump.done)
+            pthread_cond_wait(&pump.cond, &pump.lock);
+        pump.outwait += now() - start;
+        pthread_mutex_unlock(&pump.lock);
+
+        int ok = pump_output(pump.buf[k % PUMP_NBUF]);
+
+        pthread_mutex_lock(&pump.lock);
+        if (!ok)
+            pump.done = 1;
+        else
+            pump.written = k + 1;
+        pump.freed = pump.splice ? k : pump.written;
+        pthread_cond_signal(&pump.cond);
+        pthread_mutex_unlock(&pump.lock);
+        if (!ok)
+            return 0;
+    }
+}
+
+static void
+pump_start(void)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < PUMP_NBUF; i++) {
+        pump.buf[i] = aligned_alloc(page, PUMP_SIZE);
+        if (!pump.buf[i]) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pump.splice = fcntl(STDOUT_FILENO, F_SETPIPE_SZ, (int)PUMP_SIZE) != -1 &&
+                  fcntl(STDOUT_FILENO, F_GETPIPE_SZ) <= (int)PUMP_SIZE;
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&pump.lock, 0);
+    pthread_cond_init(&pump.cond, 0);
+    pump.start = now();
+    pthread_create(&pump.writer, 0, pump_writer, 0);
+}
+
+/* Return the next buffer to fill, or null once output has failed. */
+static uint64_t *
+pump_acquire(void)
+{
+    pthread_mutex_lock(&pump.lock);
+    double start = now();
+    while (pump.filled - pump.freed >= PUMP_NBUF && !pump.done)
+        pthread_cond_wait(&pump.cond, &pump.lock);
+    pump.genwait += now() - start;
+    uint64_t *buf = pump.done ? 0 : pump.buf[pump.filled % PUMP_NBUF];
+    pthread_mutex_unlock(&pump.lock);
+    return buf;
+}
+
+static void
+pump_release(void)
+{
+    pthread_mutex_lock(&pump.lock);
+    pump.filled++;
+    pthread_cond_signal(&pump.cond);
+    pthread_mutex_unlock(&pump.lock);
+}
+
+/* Report sustained throughput. If the generator spent most of its
+ * time waiting, the pipe and its reader are the bottleneck.
+ */
+static void
+pump_finish(void)
+{
+    pthread_join(pump.writer, 0);
+    double elapsed = now() - pump.start;
+    double mb = pump.written * (PUMP_SIZE / 1024.0 / 1024.0);
+    fprintf(stderr, "pump: %.0f MB in %.3f s, %.3f MB/s via %s, "
+            "generator idle %.1f%%, writer idle %.1f%%\n",
+            mb, elapsed, mb / elapsed, pump.splice ? "vmsplice" : "write",
+            100 * pump.genwait / elapsed, 100 * pump.outwait / elapsed);
+    for (int i = 0; i < PUMP_NBUF; i++)
+        free(pump.buf[i]);
+}
+
+/* Force the compiler to assume memory behind p was read. */
+#define CLOBBER(p) __asm__ volatile ("" : : "r"(p) : "memory")
+/* Force the compiler to materialize x without touching memory. */
+#define SINK(x) __asm__ volatile ("" : : "r"(x))
+
+/* Latency measurement for -l, in TSC ticks. The fences keep the timed
+ * region from overlapping surrounding instructions: lfence before
+ * rdtsc waits for prior work to retire, and rdtscp followed by lfence
+ * waits for the timed work before anything after it starts.
+ */
+#define LAT_WARMUP  (1L << 16)  /* Untimed calls before measuring */
+#define LAT_CALLS   (1L << 20)  /* Individually timed calls */
+#define LAT_BATCH   64          /* Calls per timed batch */
+#define LAT_BATCHES (1L << 14)  /* Timed batches */
+
+static uint64_t
+tsc_start(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t
+tsc_stop(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+#else
+    return tsc_start();
+#endif
+}
+
+/* Log-bucketed histogram: exact below 16, then 8 buckets per power of
+ * two, about 12% resolution.
+ */
+#define HIST_BUCKETS 512
+
+struct hist {
+    unsigned long long count[HIST_BUCKETS];
+    unsigned long long n;
+    uint64_t max;
+    uint64_t overhead;  /* Subtracted from every sample */
+};
+
+static int
+hist_bucket(uint64_t v)
+{
+    if (v < 16)
+        return v;
+    int e = 63 - __builtin_clzll(v);
+    return 16 + (e - 4) * 8 + (v >> (e - 3) & 7);
+}
+
+static uint64_t
+hist_lower(int b)
+{
+    if (b < 16)
+        return b;
+    int e = (b - 16) / 8 + 4;
+    return (uint64_t)(8 + (b - 16) % 8) << (e - 3);
+}
+
+static void
+hist_add(struct hist *h, uint64_t v)
+{
+    v = v > h->overhead ? v - h->overhead : 0;
+    h->count[hist_bucket(v)]++;
+    h->n++;
+    if (v > h->max)
+        h->max = v;
+}
+
+/* Lower bound of the bucket containing quantile q. */
+static uint64_t
+hist_quantile(const struct hist *h, double q)
+{
+    unsigned long long target = q * h->n;
+    unsigned long long sum = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        sum += h->count[b];
+        if (sum > target)
+            return hist_lower(b);
+    }
+    return h->max;
+}
+
+/* The median cost of an empty timed region. */
+static uint64_t
+tsc_overhead(void)
+{
+    struct hist h = {{0}, 0, 0, 0};
+    for (long i = 0; i < LAT_CALLS; i++) {
+        uint64_t t0 = tsc_start();
+        uint64_t t1 = tsc_stop();
+        hist_add(&h, t1 - t0);
+    }
+    return hist_quantile(&h, 0.5);
+}
+
+/* Per-call timing for the default sweep and -b. Each sample runs a
+ * fixed number of calls, chosen so a sample takes about SECONDS, with
+ * no flag checks or stores in the loop: SINK() makes each output
+ * materialize in a register and nothing more. In throughput mode calls
+ * overlap freely. In latency mode a fence after each output keeps the
+ * next call from starting until the previous one is done, giving the
+ * cost of a dependent chain of calls. The same loop around the baseline
+ * generator measures the harness overhead, which is subtracted.
+ */
+enum timing {TIMING_THROUGHPUT, TIMING_LATENCY};
+
+static const char timing_name[][12] = {"throughput", "latency"};
+
+/* One generator's per-word timings. name_bench() appends samples of
+ * calls each, first calibrating calls to the target sample length if
+ * it is still zero.
+ */
+#define MAXSAMPLES 256     /* Upper limit on samples under -d */
+
+struct samples {
+    double seconds;             /* Target length of a sample */
+    long calls;                 /* Calls per sample, zero to calibrate */
+    int n;
+    int discarded;              /* Outliers dropped under -d */
+    double ci;                  /* Median's relative 95% CI, -1 if none */
+    double ns[MAXSAMPLES];
+    double cycles[MAXSAMPLES];
+};
+
+static void
+samples_init(struct samples *s, double seconds)
+{
+    s->seconds = seconds;
+    s->calls = 0;
+    s->n = 0;
+    s->discarded = 0;
+    s->ci = -1;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+#define TIMING_CALIBRATE (1L << 12)  /* Calls in the first trial run */
+#define TIMING_MIN       0.01        /* Seconds of a usable trial run */
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define TIMING_FENCE() _mm_lfence()
+#else
+#  define TIMING_FENCE() __asm__ volatile ("" : : : "memory")
+#endif
+
+/* Scale the call count from a trial run so a sample takes the given
+ * number of seconds. Short trials are repeated with twice the calls by
+ * stepping the sample index i back.
+ */
+static long
+timing_iterations(long n, double elapsed, double seconds, int *i)
+{
+    if (elapsed < TIMING_MIN) {
+        *i = -2;
+        return n * 2;
+    }
+    double scaled = n * (seconds / elapsed);
+    return scaled > 1 ? scaled : 1;
+}
+
+static double
+median(const double *samples, int n)
+{
+    double sorted[MAXSAMPLES];
+    memcpy(sorted, samples, n * sizeof(*sorted));
+    qsort(sorted, n, sizeof(*sorted), cmp_double);
+    return (sorted[(n - 1) / 2] + sorted[n / 2]) / 2;
+}
+
+/* Subtract the per-call overhead. It can hide a cheap generator's work
+ * entirely, so keep a floor rather than report zero.
+ */
+static void
+timing_correct(double *samples, int n, double overhead)
+{
+    for (int i = 0; i < n; i++) {
+        double x = samples[i] - overhead;
+        samples[i] = x > samples[i] / 100 ? x : samples[i] / 100;
+    }
+}
+
+static double
+timing_mbps(double ns)
+{
+    return 8e9 / ns / 1024.0 / 1024.0;
+}
+
+/* Adaptive sampling for -d. Instead of NSAMPLES samples of SECONDS
+ * each, take short samples until the median is pinned down: until the
+ * distribution-free 95% confidence interval of the median, read off
+ * the order statistics, is within the target of it, or the budget for
+ * the generator is spent. Quiet generators finish in well under a
+ * second and noisy ones get more samples.
+ *
+ * A frequency transition (turbo engaging, a thermal or power limit, a
+ * noisy neighbour) shows up as samples well off to one side. Samples
+ * more than ADAPT_REJECT robust standard deviations from the median,
+ * as estimated by the median absolute deviation, are dropped before
+ * the interval is computed.
+ */
+#define ADAPT_SECONDS 0.05   /* Length of one sample */
+#define ADAPT_MIN     8      /* Samples kept before stopping is allowed */
+#define ADAPT_TARGET  1.0    /* Default -d, percent */
+#define ADAPT_BUDGET  5.0    /* Default -w, seconds per generator */
+#define ADAPT_REJECT  3.5    /* Outlier cutoff in robust sigmas */
+
+struct adapt {
+    double target;           /* Relative CI half-width to reach */
+    double budget;           /* Seconds per generator */
+};
+
+/* Drop outlying samples, keeping ns and cycles paired. */
+static void
+samples_reject(struct samples *s)
+{
+    double dev[MAXSAMPLES];
+    double med = median(s->ns, s->n);
+    for (int i = 0; i < s->n; i++)
+        dev[i] = fabs(s->ns[i] - med);
+    /* 1.4826 MAD estimates the standard deviation of a normal */
+    double cut = ADAPT_REJECT * 1.4826 * median(dev, s->n);
+    if (!cut)
+        return;
+    int k = 0;
+    for (int i = 0; i < s->n; i++) {
+        if (dev[i] <= cut) {
+            s->ns[k] = s->ns[i];
+            s->cycles[k++] = s->cycles[i];
+        }
+    }
+    s->discarded += s->n - k;
+    s->n = k;
+}
+
+/* Half-width of the median's 95% confidence interval relative to the
+ * median. The interval runs between the order statistics at ranks
+ * n/2 -+ 1.96 sqrt(n)/2, which needs no assumption about the shape of
+ * the distribution.
+ */
+static double
+samples_ci(const struct samples *s)
+{
+    double sorted[MAXSAMPLES];
+    memcpy(sorted, s->ns, s->n * sizeof(*sorted));
+    qsort(sorted, s->n, sizeof(*sorted), cmp_double);
+    double h = 1.96 * sqrt(s->n) / 2;
+    int lo = (int)lround(s->n / 2.0 - h) - 1;
+    int hi = (int)lround(s->n / 2.0 + h);
+    lo = lo < 0 ? 0 : lo;
+    hi = hi > s->n - 1 ? s->n - 1 : hi;
+    return (sorted[hi] - sorted[lo]) / 2 / median(s->ns, s->n);
+}
+
+/* Sample one generator until its median is known to the target. */
+static void
+adaptive(void (*bench)(enum timing, struct samples *, int),
+         enum timing timing, const struct adapt *a, struct samples *s)
+{
+    struct samples raw;
+    samples_init(&raw, ADAPT_SECONDS);
+    double start = now();
+    for (;;) {
+        bench(timing, &raw, 1);
+        *s = raw;
+        samples_reject(s);
+        s->ci = samples_ci(s);
+        if (s->n >= ADAPT_MIN && s->ci <= a->target)
+            break;
+        if (raw.n == MAXSAMPLES || now() - start >= a->budget)
+            break;
+    }
+}
+
+/* Hardware counters for -p, wrapped around the same timed loop. The
+ * counts are raw, so the baseline row shows the harness's share.
+ */
+static struct counters counters;
+
+/* Conversion benchmark for -u: values per block between alarm checks.
+ * The scalar path draws and converts one value at a time.
+ */
+#define CONVERT_BLOCK 1024
+
+union convert_out {
+    uint64_t u[CONVERT_BLOCK];
+    double d[CONVERT_BLOCK];
+    float f[2 * CONVERT_BLOCK];
+};
+
+#define CONVERT_SCALAR(rand64, conv, x, range, out, c) \
+    switch (conv) { \
+        case CONVERT_BOUNDED: \
+            for (int i = 0; i < CONVERT_BLOCK; i++) \
+                CONVERT_BOUNDED(rand64, x, range, (out)->u[i]); \
+            c += CONVERT_BLOCK; \
+            break; \
+        case CONVERT_DOUBLE53: \
+            for (int i = 0; i < CONVERT_BLOCK; i++) { \
+                rand64(x); \
+                (out)->d[i] = convert_double53(x); \
+            } \
+            c += CONVERT_BLOCK; \
+            break; \
+        case CONVERT_DOUBLE64: \
+            for (int i = 0; i < CONVERT_BLOCK; i++) { \
+                rand64(x); \
+                (out)->d[i] = convert_double64(x); \
+            } \
+            c += CONVERT_BLOCK; \
+            break; \
+        case CONVERT_FLOATS: \
+            for (int i = 0; i < CONVERT_BLOCK; i++) { \
+                rand64(x); \
+                convert_floats(x, (out)->f + 2 * i, (out)->f + 2 * i + 1); \
+            } \
+            c += 2 * CONVERT_BLOCK; \
+            break; \
+        case CONVERT_COUNT: \
+            break; \
+    }
+
+/* Ziggurat benchmark for -z: variates per block between alarm checks. */
+#define ZIGGURAT_BLOCK 1024
+
+#define ZIGGURAT_SCALAR(rand64, dist, x, out) \
+    switch (dist) { \
+        case ZIGGURAT_NORMAL: \
+            for (int i = 0; i < ZIGGURAT_BLOCK; i++) \
+                ZIGGURAT_NORMAL(rand64, x, (out)[i]); \
+            break; \
+        case ZIGGURAT_EXPONENTIAL: \
+            for (int i = 0; i < ZIGGURAT_BLOCK; i++) \
+                ZIGGURAT_EXPONENTIAL(rand64, x, (out)[i]); \
+            break; \
+        case ZIGGURAT_COUNT: \
+            break; \
+    }
+
+#define DEFINE_BENCH(name, kind, param) \
+    static void \
+    name##_bench(enum timing mode, struct samples *s, int count) \
+    { \
+        long n = s->calls ? s->calls : TIMING_CALIBRATE; \
+        for (int i = s->calls ? 0 : -1; i < count; i++) { \
+            uint64_t r; \
+            kind##_SETUP(name, param, seed); \
+            counters_start(&counters); \
+            double start = now(); \
+            uint64_t t0 = tsc_start(); \
+            if (mode == TIMING_LATENCY) { \
+                for (long k = 0; k < n; k++) { \
+                    kind##_RAND(r); \
+                    SINK(r); \
+                    TIMING_FENCE(); \
+                } \
+            } else { \
+                for (long k = 0; k < n; k++) { \
+                    kind##_RAND(r); \
+                    SINK(r); \
+                } \
+            } \
+            uint64_t t1 = tsc_stop(); \
+            double elapsed = now() - start; \
+            counters_stop(&counters, i < 0 ? 0 : n); \
+            if (i < 0) { \
+                n = timing_iterations(n, elapsed, s->seconds, &i); \
+            } else { \
+                s->ns[s->n] = elapsed * 1e9 / n; \
+                s->cycles[s->n++] = (double)(t1 - t0) / n; \
+            } \
+        } \
+        s->calls = n; \
+    } \
+\
+    static void \
+    name##_blocks(uint64_t *buf, double *rates) \
+    { \
+        for (int b = 0; b < NBLOCKS; b++) { \
+            size_t n = blocks[b] / sizeof(*buf); \
+            double best = 0; \
+            for (int i = 0; i < NSAMPLES; i++) { \
+                running = 1; \
+                unsigned long long c = 0; \
+                kind##_SETUP(name, param, seed); \
+                signal(SIGALRM, alarm_handler); \
+                double start = now(); \
+                alarm(SECONDS); \
+                while (running) { \
+                    kind##_FILL(buf, n); \
+                    CLOBBER(buf); \
+                    c += n; \
+                } \
+                double rate = 8.0 * c / (now() - start); \
+                if (rate > best) \
+                    best = rate; \
+            } \
+            rates[b] = best / 1024.0 / 1024.0; \
+        } \
+    } \
+\
+    static void \
+    name##_latency(struct hist *call, struct hist *batch) \
+    { \
+        uint64_t r; \
+        kind##_SETUP(name, param, seed); \
+        for (long i = 0; i < LAT_WARMUP; i++) { \
+            kind##_RAND(r); \
+            SINK(r); \
+        } \
+        for (long i = 0; i < LAT_CALLS; i++) { \
+            uint64_t t0 = tsc_start(); \
+            kind##_RAND(r); \
+            SINK(r); \
+            uint64_t t1 = tsc_stop(); \
+            hist_add(call, t1 - t0); \
+        } \
+        for (long i = 0; i < LAT_BATCHES; i++) { \
+            uint64_t t0 = tsc_start(); \
+            for (int j = 0; j < LAT_BATCH; j++) { \
+                kind##_RAND(r); \
+                SINK(r); \
+            } \
+            uint64_t t1 = tsc_stop(); \
+            hist_add(batch, t1 - t0); \
+        } \
+    } \
+\
+    static void \
+    name##_pump(void) \
+    { \
+        kind##_SETUP(name, param, seed); \
+        uint64_t *buf; \
+        pump_start(); \
+        while ((buf = pump_acquire())) { \
+            kind##_FILL(buf, PUMP_SIZE / sizeof(*buf)); \
+            pump_release(); \
+        } \
+        pump_finish(); \
+    } \
+\
+    static void * \
+    name##_thread(void *arg) \
+    { \
+        struct worker *w = arg; \
+        volatile uint64_t *out = w->out; \
+        unsigned long long mask = w->mask; \
+        unsigned long long c = 0; \
+        worker_pin(w); \
+        kind##_SETUP(name, param, w->seed); \
+        pthread_barrier_wait(w->start); \
+        while (running) { \
+            for (int i = 0; i < UNROLL; i++) { \
+                kind##_RAND(out[c++ & mask]); \
+            } \
+        } \
+        w->count = c; \
+        return 0; \
+    } \
+\
+    static void * \
+    name##_serve(void *arg) \
+    { \
+        struct producer *pr = arg; \
+        kind##_SETUP(name, param, pr->seed); \
+        uint64_t *buf; \
+        while ((buf = ring_acquire(pr->ring, pr->queue))) { \
+            kind##_FILL(buf, RING_WORDS); \
+            ring_publish(pr->queue); \
+            pr->blocks++; \
+        } \
+        return 0; \
+    } \
+\
     static void \
-    name##_bench(void) \
+    name##_check(const struct qtest *q, void *qs) \
     { \
-        unsigned long long best = 0; \
+        uint64_t qbuf[QUALITY_BLOCK]; \
+        kind##_SETUP(name, param, seed); \
+        for (size_t n = 0; n < q->words; n += QUALITY_BLOCK) { \
+            kind##_FILL(qbuf, QUALITY_BLOCK); \
+            q->feed(qs, qbuf, QUALITY_BLOCK); \
+        } \
+    } \
+\
+    static double \
+    name##_convert(enum convert conv, int bulk, uint64_t range) \
+    { \
+        static uint64_t in[CONVERT_BLOCK]; \
+        static union convert_out out; \
+        double best = 0; \
         for (int i = 0; i < NSAMPLES; i++) { \
             running = 1; \
             unsigned long long c = 0; \
-            setup(); \
+            uint64_t x; \
+            kind##_SETUP(name, param, seed); \
             signal(SIGALRM, alarm_handler); \
+            double start = now(); \
             alarm(SECONDS); \
             while (running) { \
-                for (int i = 0; i < UNROLL; i++) { \
-                    rand64(buffer[c++ % N]); \
+                if (bulk) { \
+                    kind##_FILL(in, CONVERT_BLOCK); \
+                    c += convert_bulk(conv, &out, in, CONVERT_BLOCK, range); \
+                } else { \
+                    CONVERT_SCALAR(kind##_RAND, conv, x, range, &out, c); \
                 } \
+                CLOBBER(&out); \
             } \
-            if (c > best) \
-                best = c; \
+            double rate = c / (now() - start); \
+            if (rate > best) \
+                best = rate; \
         } \
-        double rate = 8.0 * best / SECONDS / 1024.0 / 1024.0; \
-        printf("%-20s%f MB/s\n", STR(name), rate); \
-        fflush(stdout); \
+        return best; \
     } \
 \
-    static void \
-    name##_pump(void) \
+    static double \
+    name##_ziggurat(enum ziggurat dist, int bulk) \
     { \
-        setup(); \
-        uint64_t r; \
-        do { \
-            rand64(r); \
-        } while (fwrite(&r, sizeof(r), 1, stdout)); \
+        static uint64_t in[ZIGGURAT_BLOCK]; \
+        static double out[ZIGGURAT_BLOCK]; \
+        double best = 0; \
+        for (int i = 0; i < NSAMPLES; i++) { \
+            running = 1; \
+            unsigned long long c = 0; \
+            uint64_t x; \
+            kind##_SETUP(name, param, seed); \
+            signal(SIGALRM, alarm_handler); \
+            double start = now(); \
+            alarm(SECONDS); \
+            while (running) { \
+                if (!bulk) { \
+                    ZIGGURAT_SCALAR(kind##_RAND, dist, x, out); \
+                } else if (dist == ZIGGURAT_NORMAL) { \
+                    kind##_FILL(in, ZIGGURAT_BLOCK); \
+                    ZIGGURAT_NORMAL_BULK(kind##_RAND, x, out, in, \
+                                         ZIGGURAT_BLOCK); \
+                } else { \
+                    kind##_FILL(in, ZIGGURAT_BLOCK); \
+                    ZIGGURAT_EXPONENTIAL_BULK(kind##_RAND, x, out, in, \
+                                              ZIGGURAT_BLOCK); \
+                } \
+                CLOBBER(out); \
+                c += ZIGGURAT_BLOCK; \
+            } \
+            double rate = c / (now() - start); \
+            if (rate > best) \
+                best = rate; \
+        } \
+        return best; \
+    } \
+\
+    static double \
+    name##_construct(void) \
+    { \
+        double best = 0; \
+        for (int i = 0; i < NSAMPLES; i++) { \
+            running = 1; \
+            unsigned long long c = 0; \
+            signal(SIGALRM, alarm_handler); \
+            double start = now(); \
+            alarm(SECONDS); \
+            while (running) { \
+                uint64_t r; \
+                kind##_SETUP(name, param, seed + c); \
+                kind##_RAND(r); \
+                SINK(r); \
+                c++; \
+            } \
+            double rate = c / (now() - start); \
+            if (rate > best) \
+                best = rate; \
+        } \
+        return best; \
     }
 
 static uint64_t
@@ -230,203 +1014,2273 @@ sfc64(uint64_t s[4])
     return r;
 }
 
-#define BASELINE_SETUP()
-#define BASELINE_RAND(dst) \
-    dst = 0
-
-#define XORSHIFT64STAR_SETUP() \
-    uint64_t state = 0xdeadbeefcafebabe
-#define XORSHIFT64STAR_RAND(dst) \
-    dst = xorshift64star(&state)
+/* True 128-bit state PCGs, where spcg64 and pcg64 above pair two 64-bit
+ * LCGs. pcg128 is PCG's pcg64, XSL-RR output over a 128-bit LCG, as in
+ * numpy's PCG64. pcg128dxsm is numpy's PCG64DXSM, the DXSM output of the
+ * state before a step of an LCG with a 64-bit "cheap" multiplier.
+ * mcg128 is the bare 128-bit multiplicative generator with that same
+ * multiplier, returning the high half (Lemire's lehmer64).
+ *
+ * The state is 64-bit words, low word first, with the LCG increment
+ * following the state. The increment and the MCG state must be odd,
+ * which is forced as they are used so any seeded state works.
+ */
+#define PCG128_MUL_LO UINT64_C(0x4385df649fccf645)
+#define PCG128_MUL_HI UINT64_C(0x2360ed051fc65da4)
+#define PCG128_CHEAP  UINT64_C(0xda942042e4dd58b5)
 
-#define XORSHIFT128PLUS_SETUP() \
-    uint64_t state[] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}
-#define XORSHIFT128PLUS_RAND(dst) \
-    dst = xorshift128plus(state)
+/* The low 128 bits of (hi:lo) * (mhi:mlo). Only lo * mlo needs its full
+ * product. With BMI2 that is one mulx, which leaves the flags alone so
+ * the carry chain of the following add can be scheduled around it.
+ */
+static inline unsigned __int128
+mul128(uint64_t lo, uint64_t hi, uint64_t mlo, uint64_t mhi)
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+    unsigned long long h;
+    uint64_t l = _mulx_u64(lo, mlo, &h);
+    h += hi * mlo + lo * mhi;
+    return (unsigned __int128)h << 64 | l;
+#else
+    unsigned __int128 x = (unsigned __int128)hi << 64 | lo;
+    return x * ((unsigned __int128)mhi << 64 | mlo);
+#endif
+}
 
-#define XORSHIFT1024STAR_SETUP() \
-    int p = 0; \
-    uint64_t state[16] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}; \
-    uint64_t pre[] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}; \
-    for (int i = 0; i < 16; i++) state[i] = xorshift64star(pre)
-#define XORSHIFT1024STAR_RAND(dst) \
-    dst = xorshift1024star(state, &p)
+static uint64_t
+pcg128(uint64_t s[4])
+{
+    unsigned __int128 x = mul128(s[0], s[1], PCG128_MUL_LO, PCG128_MUL_HI);
+    x += (unsigned __int128)s[3] << 64 | (s[2] | 1);
+    s[0] = x;
+    s[1] = x >> 64;
+    uint64_t v = s[1] ^ s[0];
+    int r = s[1] >> 58;
+    return (v >> r) | (v << (-r & 63));
+}
 
-#define XOROSHIRO128PLUS_SETUP() \
-    uint64_t state[] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}
-#define XOROSHIRO128PLUS_RAND(dst) \
-    dst = xoroshiro128plus(state)
+static uint64_t
+pcg128dxsm(uint64_t s[4])
+{
+    uint64_t hi = s[1];
+    hi ^= hi >> 32;
+    hi *= PCG128_CHEAP;
+    hi ^= hi >> 48;
+    hi *= s[0] | 1;
+    unsigned __int128 x = mul128(s[0], s[1], PCG128_CHEAP, 0);
+    x += (unsigned __int128)s[3] << 64 | (s[2] | 1);
+    s[0] = x;
+    s[1] = x >> 64;
+    return hi;
+}
 
-#define BLOWFISHCBC_SETUP() \
-    struct blowfish ctx[1]; \
-    blowfish_init(ctx, "", 1); \
-    uint32_t state[2] = {0, 0}
-#define BLOWFISHCBC16_RAND(dst) \
-    blowfish_encrypt16(ctx, state + 0, state + 1); \
-    dst = ((uint64_t)state[1] << 32) | state[0]
-#define BLOWFISHCBC4_RAND(dst) \
-    blowfish_encrypt4(ctx, state + 0, state + 1); \
-    dst = ((uint64_t)state[1] << 32) | state[0]
+static uint64_t
+mcg128(uint64_t s[2])
+{
+    unsigned __int128 x = mul128(s[0] | 1, s[1], PCG128_CHEAP, 0);
+    s[0] = x;
+    s[1] = x >> 64;
+    return s[1];
+}
 
-#define BLOWFISHCTR_SETUP() \
-    struct blowfish ctx[1]; \
-    blowfish_init(ctx, "seed", 5); \
-    uint64_t ctr = 0; \
-    uint32_t block[2]
-#define BLOWFISHCTR16_RAND(dst) \
-    block[0] = ctr >> 32; \
-    block[1] = ctr++; \
-    blowfish_encrypt16(ctx, block + 0, block + 1); \
-    dst = ((uint64_t)block[1] << 32) | block[0]
-#define BLOWFISHCTR4_RAND(dst) \
-    block[0] = ctr >> 32; \
-    block[1] = ctr++; \
-    blowfish_encrypt4(ctx, block + 0, block + 1); \
-    dst = ((uint64_t)block[1] << 32) | block[0]
+/* Define name_fill(), a bulk version of name() that keeps the state in
+ * locals, and so in registers, for the whole block.
+ */
+#define DEFINE_FILL(name, words) \
+    static void \
+    name##_fill(uint64_t s[words], uint64_t *buf, size_t n) \
+    { \
+        uint64_t t[words]; \
+        memcpy(t, s, sizeof(t)); \
+        for (size_t i = 0; i < n; i++) \
+            buf[i] = name(t); \
+        memcpy(s, t, sizeof(t)); \
+    }
 
-#define MT64_SETUP() \
-    struct mt64 mt64[1]; \
-    mt_init(mt64, UINT64_C(0xdeadbeefcafebabe))
-#define MT64_RAND(dst) \
-    dst = mt_rand(mt64)
+DEFINE_FILL(xorshift64star, 1)
+DEFINE_FILL(xorshift128plus, 2)
+DEFINE_FILL(xoroshiro128plus, 2)
+DEFINE_FILL(spcg64, 2)
+DEFINE_FILL(pcg64, 2)
+DEFINE_FILL(msws64, 2)
+DEFINE_FILL(xoshiro256ss, 4)
+DEFINE_FILL(xoshiro256pp, 4)
+DEFINE_FILL(splitmix64, 1)
+DEFINE_FILL(mwc256xxa64, 4)
+DEFINE_FILL(sfc64, 4)
+DEFINE_FILL(pcg128, 4)
+DEFINE_FILL(pcg128dxsm, 4)
 
-#define SPCG64_SETUP() \
-    uint64_t state[] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}
-#define SPCG64_RAND(dst) \
-    dst = spcg64(state)
+/* The state only needs forcing odd once, not on every step where the
+ * OR would sit on the multiply's dependency chain.
+ */
+static void
+mcg128_fill(uint64_t s[2], uint64_t *buf, size_t n)
+{
+    uint64_t lo = s[0] | 1;
+    uint64_t hi = s[1];
+    for (size_t i = 0; i < n; i++) {
+        unsigned __int128 x = mul128(lo, hi, PCG128_CHEAP, 0);
+        lo = x;
+        hi = x >> 64;
+        buf[i] = hi;
+    }
+    s[0] = lo;
+    s[1] = hi;
+}
 
-#define PCG64_SETUP() \
-    uint64_t state[] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}
-#define PCG64_RAND(dst) \
-    dst = pcg64(state)
+static void
+xorshift1024star_fill(uint64_t s[16], int *p, uint64_t *buf, size_t n)
+{
+    int i = *p;
+    for (size_t k = 0; k < n; k++)
+        buf[k] = xorshift1024star(s, &i);
+    *p = i;
+}
 
-#define RC4_SETUP() \
-    struct rc4 rc4[1]; \
-    rc4_init(rc4, "seed", 5); \
-    uint64_t v
-#define RC4_RAND(dst) \
-    rc4_rand(rc4, &v, sizeof(v)); \
-    dst = v
+/* Define name_jump(s, k), which advances an F2-linear generator 2^k
+ * steps (k modulo the state size in bits). The jump table is built on
+ * first use from the low bit of s[0] across 2 * 64 * words steps.
+ */
+#define DEFINE_JUMP(name, nwords) \
+    static struct gf2_jumps name##_jumps; \
+    static void \
+    name##_jump(uint64_t s[nwords], int k) \
+    { \
+        if (!name##_jumps.poly) { \
+            uint64_t seq[GF2_WORDS(2 * 64 * nwords)] = {0}; \
+            uint64_t t[nwords]; \
+            memcpy(t, s, sizeof(t)); \
+            for (int i = 0; i < 2 * 64 * nwords; i++) { \
+                seq[i / 64] |= (t[0] & 1) << (i % 64); \
+                name(t); \
+            } \
+            if (!gf2_jumps_init(&name##_jumps, seq, 2 * 64 * nwords) || \
+                    name##_jumps.degree != 64 * nwords) \
+                abort(); \
+        } \
+        const uint64_t *poly = name##_jumps.poly + \
+                               k % (64 * nwords) * name##_jumps.words; \
+        uint64_t t[nwords]; \
+        memset(t, 0, sizeof(t)); \
+        for (int b = 0; b < 64 * nwords; b++) { \
+            if (poly[b / 64] >> (b % 64) & 1) \
+                for (int i = 0; i < nwords; i++) \
+                    t[i] ^= s[i]; \
+            name(s); \
+        } \
+        memcpy(s, t, sizeof(t)); \
+    }
 
-#define MSWS64_SETUP() \
-    uint64_t state[] = {0xdeadbeefcafebabe, 0x8badf00dbaada555}
-#define MSWS64_RAND(dst) \
-    dst = msws64(state)
-
-#define XOSHIRO256SS_SETUP() \
-    uint64_t state[] = { \
-        0xdeadbeefcafebabe, 0x8badf00dbaada555, \
-        0x4cf08ad601831eb6, 0x9d6f4cccb35e7af9 \
-    }
-#define XOSHIRO256SS_RAND(dst) \
-    dst = xoshiro256ss(state)
-
-#define XOSHIRO256PP_SETUP() \
-    uint64_t state[] = { \
-        0xdeadbeefcafebabe, 0x8badf00dbaada555, \
-        0x4cf08ad601831eb6, 0x9d6f4cccb35e7af9 \
-    }
-#define XOSHIRO256PP_RAND(dst) \
-    dst = xoshiro256pp(state)
-
-#define SPLITMIX64_SETUP() \
-    uint64_t state[] = {0xdeadbeefcafebabe}
-#define SPLITMIX64_RAND(dst) \
-    dst = splitmix64(state)
-
-#define MWC256XXA64_SETUP() \
-    uint64_t state[] = { \
-        0xdeadbeefcafebabe, 0x8badf00dbaada555, \
-        0x4cf08ad601831eb6, 0x9d6f4cccb35e7af9 \
-    }
-#define MWC256XXA64_RAND(dst) \
-    dst = mwc256xxa64(state)
-
-#define SFC64_SETUP() \
-    uint64_t state[] = { \
-        0xdeadbeefcafebabe, 0x8badf00dbaada555, \
-        0x4cf08ad601831eb6, 0x9d6f4cccb35e7af9 \
-    }
-#define SFC64_RAND(dst) \
-    dst = sfc64(state)
-
-DEFINE_BENCH(baseline, BASELINE_SETUP, BASELINE_RAND);
-DEFINE_BENCH(xorshift64star, XORSHIFT64STAR_SETUP, XORSHIFT64STAR_RAND);
-DEFINE_BENCH(xorshift128plus, XORSHIFT128PLUS_SETUP, XORSHIFT128PLUS_RAND);
-DEFINE_BENCH(xoroshiro128plus, XOROSHIRO128PLUS_SETUP, XOROSHIRO128PLUS_RAND);
-DEFINE_BENCH(xorshift1024star, XORSHIFT1024STAR_SETUP, XORSHIFT1024STAR_RAND);
-DEFINE_BENCH(blowfishcbc16, BLOWFISHCBC_SETUP, BLOWFISHCBC16_RAND);
-DEFINE_BENCH(blowfishcbc4, BLOWFISHCBC_SETUP, BLOWFISHCBC4_RAND);
-DEFINE_BENCH(blowfishctr16, BLOWFISHCTR_SETUP, BLOWFISHCTR16_RAND);
-DEFINE_BENCH(blowfishctr4, BLOWFISHCTR_SETUP, BLOWFISHCTR4_RAND);
-DEFINE_BENCH(mt64, MT64_SETUP, MT64_RAND);
-DEFINE_BENCH(spcg64, SPCG64_SETUP, SPCG64_RAND);
-DEFINE_BENCH(pcg64, PCG64_SETUP, PCG64_RAND);
-DEFINE_BENCH(rc4, RC4_SETUP, RC4_RAND);
-DEFINE_BENCH(msws64, MSWS64_SETUP, MSWS64_RAND);
-DEFINE_BENCH(xoshiro256ss, XOSHIRO256SS_SETUP, XOSHIRO256SS_RAND);
-DEFINE_BENCH(xoshiro256pp, XOSHIRO256PP_SETUP, XOSHIRO256PP_RAND);
-DEFINE_BENCH(splitmix64, SPLITMIX64_SETUP, SPLITMIX64_RAND);
-DEFINE_BENCH(mwc256xxa64, MWC256XXA64_SETUP, MWC256XXA64_RAND);
-DEFINE_BENCH(sfc64, SFC64_SETUP, SFC64_RAND);
+DEFINE_JUMP(xorshift64star, 1)
+DEFINE_JUMP(xorshift128plus, 2)
+DEFINE_JUMP(xoroshiro128plus, 2)
+DEFINE_JUMP(xoshiro256ss, 4)
+DEFINE_JUMP(xoshiro256pp, 4)
 
-int
-main(int argc, char **argv)
+/* The state is rotated by p, so accumulate it in logical order. The
+ * jump takes a multiple of 16 steps, leaving p unchanged.
+ */
+static void
+xorshift1024star_jump(uint64_t s[16], int *p, int k)
 {
-    static const struct {
-        void (*bench)(void);
-        void (*pump)(void);
-        const char name[24];
-    } prngs[] = {
-        {baseline_bench,         baseline_pump,         "baseline"},
-        {xorshift64star_bench,   xorshift64star_pump,   "xorshift64star"},
-        {xorshift128plus_bench,  xorshift128plus_pump,  "xorshift128plus"},
-        {xorshift1024star_bench, xorshift1024star_pump, "xorshift1024star"},
-        {xoroshiro128plus_bench, xoroshiro128plus_pump, "xoroshiro128plus"},
-        {blowfishcbc16_bench,    blowfishcbc16_pump,    "blowfishcbc16"},
-        {blowfishcbc4_bench,     blowfishcbc4_pump,     "blowfishcbc4"},
-        {blowfishctr16_bench,    blowfishctr16_pump,    "blowfishctr16"},
-        {blowfishctr4_bench,     blowfishctr4_pump,     "blowfishctr4"},
-        {mt64_bench,             mt64_pump,             "mt64"},
-        {spcg64_bench,           spcg64_pump,           "spcg64"},
-        {pcg64_bench,            pcg64_pump,            "pcg64"},
-        {rc4_bench,              rc4_pump,              "rc4"},
-        {msws64_bench,           msws64_pump,           "msws64"},
-        {xoshiro256ss_bench,     xoshiro256ss_pump,     "xoshiro256starstar"},
-        {xoshiro256pp_bench,     xoshiro256pp_pump,     "xoshiro256plusplus"},
-        {splitmix64_bench,       splitmix64_pump,       "splitmix64"},
-        {mwc256xxa64_bench,      mwc256xxa64_pump,      "mwc256xxa64"},
-        {sfc64_bench,            sfc64_pump,            "sfc64"},
-    };
-    static const int nprngs = sizeof(prngs) / sizeof(*prngs);
+    static struct gf2_jumps jumps;
+    if (!jumps.poly) {
+        uint64_t seq[GF2_WORDS(2 * 1024)] = {0};
+        uint64_t t[16];
+        int q = *p;
+        memcpy(t, s, sizeof(t));
+        for (int i = 0; i < 2 * 1024; i++) {
+            xorshift1024star(t, &q);
+            seq[i / 64] |= (t[q] & 1) << (i % 64);
+        }
+        if (!gf2_jumps_init(&jumps, seq, 2 * 1024) || jumps.degree != 1024)
+            abort();
+    }
+    const uint64_t *poly = jumps.poly + k % 1024 * jumps.words;
+    uint64_t t[16] = {0};
+    for (int b = 0; b < 1024; b++) {
+        if (poly[b / 64] >> (b % 64) & 1)
+            for (int i = 0; i < 16; i++)
+                t[i] ^= s[(i + *p) & 15];
+        xorshift1024star(s, p);
+    }
+    for (int i = 0; i < 16; i++)
+        s[(i + *p) & 15] = t[i];
+}
 
-    /* Options */
-    int g = -1;
+/* Advance the LCG x = x*m + a by delta steps in O(log delta) (Brown,
+ * "Random Number Generation with Arbitrary Strides", 1994).
+ */
+static uint64_t
+lcg64_advance(uint64_t x, uint64_t m, uint64_t a, uint64_t delta)
+{
+    uint64_t accm = 1;
+    uint64_t acca = 0;
+    while (delta) {
+        if (delta & 1) {
+            accm *= m;
+            acca = acca * m + a;
+        }
+        a *= m + 1;
+        m *= m;
+        delta >>= 1;
+    }
+    return accm * x + acca;
+}
+
+static void
+spcg64_advance(uint64_t s[2], uint64_t delta)
+{
+    uint64_t m  = 0x9b60933458e17d7d;
+    uint64_t a0 = 0xd737232eeccdf7ed;
+    uint64_t a1 = 0x8b260b70b8e98891;
+    s[0] = lcg64_advance(s[0], m, a0, delta);
+    s[1] = lcg64_advance(s[1], m, a1, delta);
+}
+
+static void
+pcg64_advance(uint64_t s[2], uint64_t delta)
+{
+    uint64_t m  = 0x5851f42d4c957f2d;
+    uint64_t a0 = 0xd737232eeccdf7ed;
+    uint64_t a1 = 0x8b260b70b8e98891;
+    s[0] = lcg64_advance(s[0], m, a0, delta);
+    s[1] = lcg64_advance(s[1], m, a1, delta);
+}
+
+/* The same for 128-bit LCGs, and MCGs with a = 0. */
+static unsigned __int128
+lcg128_advance(unsigned __int128 x, unsigned __int128 m, unsigned __int128 a,
+               unsigned __int128 delta)
+{
+    unsigned __int128 accm = 1;
+    unsigned __int128 acca = 0;
+    while (delta) {
+        if (delta & 1) {
+            accm *= m;
+            acca = acca * m + a;
+        }
+        a *= m + 1;
+        m *= m;
+        delta >>= 1;
+    }
+    return accm * x + acca;
+}
+
+static void
+pcg128_advance(uint64_t s[4], unsigned __int128 delta, uint64_t mlo,
+               uint64_t mhi)
+{
+    unsigned __int128 x = (unsigned __int128)s[1] << 64 | s[0];
+    unsigned __int128 m = (unsigned __int128)mhi << 64 | mlo;
+    unsigned __int128 a = (unsigned __int128)s[3] << 64 | (s[2] | 1);
+    x = lcg128_advance(x, m, a, delta);
+    s[0] = x;
+    s[1] = x >> 64;
+}
+
+static void
+mcg128_advance(uint64_t s[2], unsigned __int128 delta)
+{
+    unsigned __int128 x = (unsigned __int128)s[1] << 64 | (s[0] | 1);
+    x = lcg128_advance(x, PCG128_CHEAP, 0, delta);
+    s[0] = x;
+    s[1] = x >> 64;
+}
+
+static void
+splitmix64_advance(uint64_t *s, uint64_t delta)
+{
+    *s += delta * UINT64_C(0x9e3779b97f4a7c15);
+}
+
+/* Seeding. Every generator's state is expanded from one 64-bit seed
+ * with splitmix64, so -s selects a whole family of states at once.
+ */
+static uint64_t seed = 0xdeadbeefcafebabe;
+#define SEED_INSTANCES (1L << 20)  /* Instances seeded per -i sample */
+
+/* Fill n state words from the splitmix64 stream starting at seed. An
+ * all-zero state is a fixed point of the xor-based generators, so it is
+ * rejected and the stream continues.
+ */
+static void
+seed_words(uint64_t *s, int n, uint64_t seed)
+{
+    uint64_t any;
+    do {
+        any = 0;
+        for (int i = 0; i < n; i++)
+            any |= s[i] = splitmix64(&seed);
+    } while (!any);
+}
+
+/* Seed n instances of a generator with words-word states, stored
+ * back to back. Instance i takes words i * words onward of one
+ * splitmix64 stream, so instance 0 matches seed_words(). The stream is
+ * written by the bulk splitmix64_fill() in chunks small enough that the
+ * zero check finds them still in L1.
+ */
+#define SEED_CHUNK 256     /* Instances per chunk */
+
+static void
+seed_instances(uint64_t *s, size_t n, int words, uint64_t seed)
+{
+    for (size_t i = 0; i < n; i += SEED_CHUNK) {
+        size_t m = n - i < SEED_CHUNK ? n - i : SEED_CHUNK;
+        uint64_t *c = s + i * words;
+        splitmix64_fill(&seed, c, m * words);
+        for (size_t j = 0; j < m; j++) {
+            uint64_t any = 0;
+            for (int k = 0; k < words; k++)
+                any |= c[j * words + k];
+            if (!any)
+                seed_words(c + j * words, words, seed ^ (i + j));
+        }
+    }
+}
+
+/* Interleaved instances for -k. K independent states of a plain-word
+ * generator advance round-robin in one loop, so a generator bound by
+ * the latency of one dependency chain can overlap K of them. K is a
+ * compile-time constant and each instance gets its own local array,
+ * which keeps every state in registers.
+ */
+#define ILP_MAXK 8
+
+#define ILP_1(X, name, words) X(0, name, words)
+#define ILP_2(X, name, words) ILP_1(X, name, words) X(1, name, words)
+#define ILP_4(X, name, words) \
+    ILP_2(X, name, words) X(2, name, words) X(3, name, words)
+#define ILP_8(X, name, words) \
+    ILP_4(X, name, words) X(4, name, words) X(5, name, words) \
+    X(6, name, words) X(7, name, words)
+
+#define ILP_DECL(j, name, words) \
+    uint64_t s##j[words]; \
+    seed_words(s##j, words, seed + j);
+#define ILP_STEP(j, name, words) \
+    SINK(name(s##j));
+
+/* Define name_ilpK(), the best words per second over NSAMPLES. */
+#define ILP_KERNEL(name, words, K) \
+    static double \
+    name##_ilp##K(void) \
+    { \
+        double best = 0; \
+        long n = TIMING_CALIBRATE; \
+        ILP_##K(ILP_DECL, name, words) \
+        for (int i = -1; i < NSAMPLES; i++) { \
+            double start = now(); \
+            for (long k = 0; k < n; k += K) { \
+                ILP_##K(ILP_STEP, name, words) \
+            } \
+            double elapsed = now() - start; \
+            if (i < 0) { \
+                n = timing_iterations(n, elapsed, SECONDS, &i); \
+            } else if (n / elapsed > best) { \
+                best = n / elapsed; \
+            } \
+        } \
+        return best; \
+    }
+
+#define DEFINE_ILP(name, words) \
+    ILP_KERNEL(name, words, 1) \
+    ILP_KERNEL(name, words, 2) \
+    ILP_KERNEL(name, words, 4) \
+    ILP_KERNEL(name, words, 8) \
+    static double \
+    name##_ilp(int k) \
+    { \
+        switch (k) { \
+            case 1: return name##_ilp1(); \
+            case 2: return name##_ilp2(); \
+            case 4: return name##_ilp4(); \
+            case 8: return name##_ilp8(); \
+        } \
+        return 0; \
+    }
+
+/* Other kinds report 0 words per second, meaning unsupported. */
+#define ILP_NONE(name, words) \
+    static double \
+    name##_ilp(int k) \
+    { \
+        (void)k; \
+        return 0; \
+    }
+
+/* Each kind of generator supplies three macros that DEFINE_BENCH builds
+ * on:
+ *
+ *   KIND_SETUP(name, arg, seed)  declares the state as locals and
+ *                                seeds it from the 64-bit seed
+ *   KIND_RAND(dst)               assigns the next 64-bit output to dst
+ *   KIND_FILL(buf, n)            writes the next n outputs to buf
+ *
+ * along with KIND_SIZE(arg), the bytes of generator state,
+ * KIND_WORDS(arg), the number of words in a state that is nothing but
+ * plain words, or 0, and KIND_ILP, DEFINE_ILP for kinds that can be
+ * interleaved and ILP_NONE otherwise. arg is the registry's
+ * per-generator parameter, described with PRNGS below.
+ */
+
+/* Fallback fill for generators without a dedicated bulk path */
+#define RAND_FILL(rand64, buf, n) \
+    for (size_t fi = 0; fi < (n); fi++) { \
+        rand64((buf)[fi]); \
+    }
+
+#define BASELINE_SETUP(name, arg, seed)
+#define BASELINE_RAND(dst) \
+    dst = 0
+#define BASELINE_FILL(buf, n) \
+    memset(buf, 0, (n) * sizeof(*(buf)))
+#define BASELINE_SIZE(arg) 0
+#define BASELINE_WORDS(arg) 0
+#define BASELINE_ILP ILP_NONE
+
+/* Generators whose whole state is arg words, advanced by name(state)
+ * and filled in bulk by name_fill() from DEFINE_FILL. The functions are
+ * bound to const locals, which the compiler resolves and inlines.
+ */
+#define WORDS_SETUP(name, arg, seed) \
+    uint64_t (*const words_next)(uint64_t *) = name; \
+    void (*const words_fill)(uint64_t *, uint64_t *, size_t) = name##_fill; \
+    uint64_t state[arg]; \
+    seed_words(state, arg, seed); \
+    (void)words_next; \
+    (void)words_fill
+#define WORDS_RAND(dst) \
+    dst = words_next(state)
+#define WORDS_FILL(buf, n) \
+    words_fill(state, buf, n)
+#define WORDS_SIZE(arg) ((arg) * sizeof(uint64_t))
+#define WORDS_WORDS(arg) (arg)
+#define WORDS_ILP DEFINE_ILP
+
+#define XORSHIFT1024STAR_SETUP(name, arg, seed) \
+    int p = 0; \
+    uint64_t state[16]; \
+    seed_words(state, 16, seed)
+#define XORSHIFT1024STAR_RAND(dst) \
+    dst = xorshift1024star(state, &p)
+#define XORSHIFT1024STAR_FILL(buf, n) \
+    xorshift1024star_fill(state, &p, buf, n)
+#define XORSHIFT1024STAR_SIZE(arg) (16 * sizeof(uint64_t) + sizeof(int))
+#define XORSHIFT1024STAR_WORDS(arg) 16
+#define XORSHIFT1024STAR_ILP ILP_NONE
+
+#define BLOWFISH_SETUP(seed) \
+    struct blowfish ctx[1]; \
+    uint64_t key[3]; \
+    seed_words(key, 3, seed); \
+    blowfish_init(ctx, key, 16)
+
+#define BLOWFISHCBC_SETUP(name, arg, seed) \
+    BLOWFISH_SETUP(seed); \
+    uint32_t state[2] = {key[2], key[2] >> 32}
+#define BLOWFISHCBC16_SETUP BLOWFISHCBC_SETUP
+#define BLOWFISHCBC4_SETUP  BLOWFISHCBC_SETUP
+#define BLOWFISHCBC16_RAND(dst) \
+    blowfish_encrypt16(ctx, state + 0, state + 1); \
+    dst = ((uint64_t)state[1] << 32) | state[0]
+#define BLOWFISHCBC4_RAND(dst) \
+    blowfish_encrypt4(ctx, state + 0, state + 1); \
+    dst = ((uint64_t)state[1] << 32) | state[0]
+#define BLOWFISHCBC16_FILL(buf, n) \
+    RAND_FILL(BLOWFISHCBC16_RAND, buf, n)
+#define BLOWFISHCBC4_FILL(buf, n) \
+    RAND_FILL(BLOWFISHCBC4_RAND, buf, n)
+#define BLOWFISHCBC16_SIZE(arg) (sizeof(struct blowfish) + 8)
+#define BLOWFISHCBC16_WORDS(arg) 0
+#define BLOWFISHCBC16_ILP ILP_NONE
+#define BLOWFISHCBC4_SIZE(arg)  (sizeof(struct blowfish) + 8)
+#define BLOWFISHCBC4_WORDS(arg)  0
+#define BLOWFISHCBC4_ILP  ILP_NONE
+
+#define BLOWFISHCTR_SETUP(name, arg, seed) \
+    BLOWFISH_SETUP(seed); \
+    uint64_t ctr = key[2]; \
+    uint32_t block[2]
+#define BLOWFISHCTR16_SETUP BLOWFISHCTR_SETUP
+#define BLOWFISHCTR4_SETUP  BLOWFISHCTR_SETUP
+#define BLOWFISHCTR16_RAND(dst) \
+    block[0] = ctr >> 32; \
+    block[1] = ctr++; \
+    blowfish_encrypt16(ctx, block + 0, block + 1); \
+    dst = ((uint64_t)block[1] << 32) | block[0]
+#define BLOWFISHCTR4_RAND(dst) \
+    block[0] = ctr >> 32; \
+    block[1] = ctr++; \
+    blowfish_encrypt4(ctx, block + 0, block + 1); \
+    dst = ((uint64_t)block[1] << 32) | block[0]
+#define BLOWFISHCTR16_FILL(buf, n) \
+    RAND_FILL(BLOWFISHCTR16_RAND, buf, n)
+#define BLOWFISHCTR4_FILL(buf, n) \
+    RAND_FILL(BLOWFISHCTR4_RAND, buf, n)
+#define BLOWFISHCTR16_SIZE(arg) (sizeof(struct blowfish) + 8)
+#define BLOWFISHCTR16_WORDS(arg) 0
+#define BLOWFISHCTR16_ILP ILP_NONE
+#define BLOWFISHCTR4_SIZE(arg)  (sizeof(struct blowfish) + 8)
+#define BLOWFISHCTR4_WORDS(arg)  0
+#define BLOWFISHCTR4_ILP  ILP_NONE
+
+#define BLOWFISHCTRX_SETUP(name, arg, seed) \
+    BLOWFISH_SETUP(seed); \
+    uint64_t ctr = key[2]; \
+    uint64_t block[LANES_BLOCK]; \
+    int bi = LANES_BLOCK
+#define BLOWFISHCTR16X_SETUP BLOWFISHCTRX_SETUP
+#define BLOWFISHCTR4X_SETUP  BLOWFISHCTRX_SETUP
+#define BLOWFISHCTR16X_RAND(dst) \
+    if (bi == LANES_BLOCK) { \
+        blowfish_ctr16(ctx, ctr, block, LANES_BLOCK); \
+        ctr += LANES_BLOCK; \
+        bi = 0; \
+    } \
+    dst = block[bi++]
+#define BLOWFISHCTR4X_RAND(dst) \
+    if (bi == LANES_BLOCK) { \
+        blowfish_ctr4(ctx, ctr, block, LANES_BLOCK); \
+        ctr += LANES_BLOCK; \
+        bi = 0; \
+    } \
+    dst = block[bi++]
+#define BLOWFISHCTR16X_FILL(buf, n) \
+    (void)bi; \
+    (void)block; \
+    blowfish_ctr16(ctx, ctr, buf, n); \
+    ctr += n
+#define BLOWFISHCTR4X_FILL(buf, n) \
+    (void)bi; \
+    (void)block; \
+    blowfish_ctr4(ctx, ctr, buf, n); \
+    ctr += n
+#define BLOWFISHCTR16X_SIZE(arg) (sizeof(struct blowfish) + 8)
+#define BLOWFISHCTR16X_WORDS(arg) 0
+#define BLOWFISHCTR16X_ILP ILP_NONE
+#define BLOWFISHCTR4X_SIZE(arg)  (sizeof(struct blowfish) + 8)
+#define BLOWFISHCTR4X_WORDS(arg)  0
+#define BLOWFISHCTR4X_ILP  ILP_NONE
+
+#define MT64_SETUP(name, arg, seed) \
+    struct mt64 mt64[1]; \
+    uint64_t mtv[MT_N]; \
+    seed_words(mtv, MT_N, seed); \
+    mt_load(mt64, mtv)
+#define MT64_RAND(dst) \
+    dst = mt_rand(mt64)
+#define MT64_FILL(buf, n) \
+    mt_fill(mt64, buf, n)
+#define MT64_SIZE(arg) sizeof(struct mt64)
+#define MT64_WORDS(arg) 0
+#define MT64_ILP ILP_NONE
+
+#define MT64X_SETUP(name, arg, seed) \
+    struct mt64x mt64x[1]; \
+    uint64_t mtv[MT_N]; \
+    seed_words(mtv, MT_N, seed); \
+    mtx_load(mt64x, mtv)
+#define MT64X_RAND(dst) \
+    dst = mtx_rand(mt64x)
+#define MT64X_FILL(buf, n) \
+    mtx_fill(mt64x, buf, n)
+#define MT64X_SIZE(arg) sizeof(struct mt64x)
+#define MT64X_WORDS(arg) 0
+#define MT64X_ILP ILP_NONE
+
+#define RC4_SETUP(name, arg, seed) \
+    struct rc4 rc4[1]; \
+    uint64_t key[4]; \
+    seed_words(key, 4, seed); \
+    rc4_init(rc4, key, sizeof(key)); \
+    uint64_t v
+#define RC4_RAND(dst) \
+    rc4_rand(rc4, &v, sizeof(v)); \
+    dst = v
+#define RC4_FILL(buf, n) \
+    (void)v; \
+    rc4_rand(rc4, buf, (n) * sizeof(*(buf)))
+#define RC4_SIZE(arg) sizeof(struct rc4)
+#define RC4_WORDS(arg) 0
+#define RC4_ILP ILP_NONE
+
+#ifndef RC4_DROP
+#  define RC4_DROP 0       /* Keystream bytes discarded by rc4w */
+#endif
+#define RC4W_SETUP(name, arg, seed) \
+    struct rc4 rc4[1]; \
+    uint64_t key[4]; \
+    seed_words(key, 4, seed); \
+    rc4_init(rc4, key, sizeof(key)); \
+    rc4_discard(rc4, RC4_DROP); \
+    uint64_t v
+#define RC4W_RAND(dst) \
+    rc4_fill64(rc4, &v, 1); \
+    dst = v
+#define RC4W_FILL(buf, n) \
+    (void)v; \
+    rc4_fill64(rc4, buf, n)
+#define RC4W_SIZE(arg) sizeof(struct rc4)
+#define RC4W_WORDS(arg) 0
+#define RC4W_ILP ILP_NONE
+
+/* Multi-lane generators from lanes.h, where arg is the scalar name. Keep
+ * the read index in a local so it stays in a register.
+ */
+#define LANES_SETUP(arg, n, seed) \
+    struct lanes lanes[1]; \
+    int li = LANES_BLOCK; \
+    arg##_lanes(lanes, n, seed)
+#define LANES_RAND(dst) \
+    if (li == LANES_BLOCK) { \
+        lanes->fill(lanes, lanes->out, LANES_BLOCK); \
+        li = 0; \
+    } \
+    dst = lanes->out[li++]
+#define LANES_FILL(buf, n) \
+    (void)li; \
+    lanes->fill(lanes, buf, n)
+
+#define LANES4_SETUP(name, arg, seed) LANES_SETUP(arg, 4, seed)
+#define LANES4_RAND LANES_RAND
+#define LANES4_FILL LANES_FILL
+#define LANES4_SIZE(arg) sizeof(struct lanes)
+#define LANES4_WORDS(arg) 0
+#define LANES4_ILP ILP_NONE
+#define LANES8_SETUP(name, arg, seed) LANES_SETUP(arg, 8, seed)
+#define LANES8_RAND LANES_RAND
+#define LANES8_FILL LANES_FILL
+#define LANES8_SIZE(arg) sizeof(struct lanes)
+#define LANES8_WORDS(arg) 0
+#define LANES8_ILP ILP_NONE
+
+/* Counter-based generators from cbrng.h, where arg is the engine. Like
+ * the lanes, one block of bulk output is staged for single draws.
+ */
+#define CBRNG_SETUP(name, arg, seed) \
+    struct cbrng cbrng[1]; \
+    int ci = CBRNG_BLOCK; \
+    arg##_cbrng(cbrng, seed)
+#define CBRNG_RAND(dst) \
+    if (ci == CBRNG_BLOCK) { \
+        cbrng_fill(cbrng, cbrng->out, CBRNG_BLOCK); \
+        ci = 0; \
+    } \
+    dst = cbrng->out[ci++]
+#define CBRNG_FILL(buf, n) \
+    (void)ci; \
+    cbrng_fill(cbrng, buf, n)
+#define CBRNG_SIZE(arg) (5 * sizeof(uint64_t))  /* Key and counter */
+#define CBRNG_WORDS(arg) 0
+#define CBRNG_ILP ILP_NONE
+
+/* The generator registry, one line per generator:
+ *
+ *   X(name, label, kind, arg, spawn)
+ *
+ * name prefixes the generated functions and may also be given to -g,
+ * label is the displayed name, kind selects the macro family above with
+ * arg as its parameter, and spawn is the -j stream spawner, or 0 for
+ * generators that cannot jump. Everything else, the benchmarks, pump,
+ * quality checks, the -g lookup and the -h listing, follows from here.
+ */
+#define PRNGS(X) \
+    X(baseline,           "baseline",             BASELINE,         0, 0) \
+    X(xorshift64star,     "xorshift64star",       WORDS,            1, \
+      xorshift64star_spawn) \
+    X(xorshift128plus,    "xorshift128plus",      WORDS,            2, \
+      xorshift128plus_spawn) \
+    X(xorshift1024star,   "xorshift1024star",     XORSHIFT1024STAR, 0, \
+      xorshift1024star_spawn) \
+    X(xoroshiro128plus,   "xoroshiro128plus",     WORDS,            2, \
+      xoroshiro128plus_spawn) \
+    X(xoroshiro128plusx4, "xoroshiro128plusx4",   LANES4, xoroshiro128plus, 0) \
+    X(xoroshiro128plusx8, "xoroshiro128plusx8",   LANES8, xoroshiro128plus, 0) \
+    X(blowfishcbc16,      "blowfishcbc16",        BLOWFISHCBC16,    0, 0) \
+    X(blowfishcbc4,       "blowfishcbc4",         BLOWFISHCBC4,     0, 0) \
+    X(blowfishctr16,      "blowfishctr16",        BLOWFISHCTR16,    0, 0) \
+    X(blowfishctr4,       "blowfishctr4",         BLOWFISHCTR4,     0, 0) \
+    X(blowfishctr16x,     "blowfishctr16x",       BLOWFISHCTR16X,   0, 0) \
+    X(blowfishctr4x,      "blowfishctr4x",        BLOWFISHCTR4X,    0, 0) \
+    X(mt64,               "mt64",                 MT64,             0, 0) \
+    X(mt64x,              "mt64x",                MT64X,            0, 0) \
+    X(spcg64,             "spcg64",               WORDS,            2, \
+      spcg64_spawn) \
+    X(pcg64,              "pcg64",                WORDS,            2, \
+      pcg64_spawn) \
+    X(rc4,                "rc4",                  RC4,              0, 0) \
+    X(rc4w,               "rc4w",                 RC4W,             0, 0) \
+    X(msws64,             "msws64",               WORDS,            2, 0) \
+    X(xoshiro256ss,       "xoshiro256starstar",   WORDS,            4, \
+      xoshiro256ss_spawn) \
+    X(xoshiro256ssx4,     "xoshiro256starstarx4", LANES4, xoshiro256ss, 0) \
+    X(xoshiro256ssx8,     "xoshiro256starstarx8", LANES8, xoshiro256ss, 0) \
+    X(xoshiro256pp,       "xoshiro256plusplus",   WORDS,            4, \
+      xoshiro256pp_spawn) \
+    X(xoshiro256ppx4,     "xoshiro256plusplusx4", LANES4, xoshiro256pp, 0) \
+    X(xoshiro256ppx8,     "xoshiro256plusplusx8", LANES8, xoshiro256pp, 0) \
+    X(splitmix64,         "splitmix64",           WORDS,            1, \
+      splitmix64_spawn) \
+    X(splitmix64x4,       "splitmix64x4",         LANES4, splitmix64,   0) \
+    X(splitmix64x8,       "splitmix64x8",         LANES8, splitmix64,   0) \
+    X(mwc256xxa64,        "mwc256xxa64",          WORDS,            4, 0) \
+    X(sfc64,              "sfc64",                WORDS,            4, 0) \
+    X(philox4x64_10,      "philox4x64_10",        CBRNG, philox4x64_10,   0) \
+    X(philox4x64_7,       "philox4x64_7",         CBRNG, philox4x64_7,    0) \
+    X(threefry4x64_20,    "threefry4x64_20",      CBRNG, threefry4x64_20, 0) \
+    X(threefry4x64_13,    "threefry4x64_13",      CBRNG, threefry4x64_13, 0) \
+    X(splitmix64ctr,      "splitmix64ctr",        CBRNG, splitmix64ctr,   0) \
+    X(pcg128,             "pcg128",               WORDS,            4, \
+      pcg128_spawn) \
+    X(pcg128dxsm,         "pcg128dxsm",           WORDS,            4, \
+      pcg128dxsm_spawn) \
+    X(mcg128,             "mcg128",               WORDS,            2, \
+      mcg128_spawn)
+
+#define PRNG_BENCH(name, label, kind, arg, spawn) \
+    DEFINE_BENCH(name, kind, arg) \
+    kind##_ILP(name, arg)
+PRNGS(PRNG_BENCH)
+#undef PRNG_BENCH
+
+/* Stream spawners for -j: move a master state to the start of the next
+ * non-overlapping substream.
+ */
+static void
+xorshift64star_spawn(uint64_t *s)
+{
+    xorshift64star_jump(s, 32);
+}
+
+static void
+xorshift128plus_spawn(uint64_t *s)
+{
+    xorshift128plus_jump(s, 64);
+}
+
+static void
+xorshift1024star_spawn(uint64_t *s)
+{
+    int p = 0;
+    xorshift1024star_jump(s, &p, 512);
+}
+
+static void
+xoroshiro128plus_spawn(uint64_t *s)
+{
+    xoroshiro128plus_jump(s, 64);
+}
+
+static void
+xoshiro256ss_spawn(uint64_t *s)
+{
+    xoshiro256ss_jump(s, 128);
+}
+
+static void
+xoshiro256pp_spawn(uint64_t *s)
+{
+    xoshiro256pp_jump(s, 128);
+}
+
+static void
+spcg64_spawn(uint64_t *s)
+{
+    spcg64_advance(s, UINT64_C(1) << 40);
+}
+
+static void
+pcg64_spawn(uint64_t *s)
+{
+    pcg64_advance(s, UINT64_C(1) << 40);
+}
+
+static void
+pcg128_spawn(uint64_t *s)
+{
+    pcg128_advance(s, (unsigned __int128)1 << 64,
+                   PCG128_MUL_LO, PCG128_MUL_HI);
+}
+
+static void
+pcg128dxsm_spawn(uint64_t *s)
+{
+    pcg128_advance(s, (unsigned __int128)1 << 64, PCG128_CHEAP, 0);
+}
+
+static void
+mcg128_spawn(uint64_t *s)
+{
+    mcg128_advance(s, (unsigned __int128)1 << 64);
+}
+
+static void
+splitmix64_spawn(uint64_t *s)
+{
+    splitmix64_advance(s, UINT64_C(1) << 40);
+}
+
+/* Descriptor for each registered generator, generated from PRNGS. */
+struct prng {
+    void (*bench)(enum timing, struct samples *, int);
+    void (*pump)(void);
+    void *(*thread)(void *);
+    void *(*serve)(void *);
+    void (*blocks)(uint64_t *, double *);
+    void (*latency)(struct hist *, struct hist *);
+    void (*check)(const struct qtest *, void *);
+    double (*convert)(enum convert, int, uint64_t);
+    double (*ziggurat)(enum ziggurat, int);
+    double (*construct)(void);
+    double (*ilp)(int);
+    void (*spawn)(uint64_t *);
+    size_t size;                /* Bytes of generator state */
+    int words;                  /* Plain state words for seed_instances() */
+    const char id[24];          /* Function prefix, also accepted by -g */
+    const char name[24];        /* Displayed name */
+};
+
+static const struct prng prngs[] = {
+#define PRNG_ROW(name, label, kind, arg, spawn) \
+    {name##_bench, name##_pump, name##_thread, name##_serve, \
+     name##_blocks, name##_latency, name##_check, name##_convert, \
+     name##_ziggurat, name##_construct, name##_ilp, spawn, kind##_SIZE(arg), \
+     kind##_WORDS(arg), \
+     #name, label},
+    PRNGS(PRNG_ROW)
+#undef PRNG_ROW
+};
+#define NPRNGS (int)(sizeof(prngs) / sizeof(*prngs))
+
+/* Find a generator by index, id or displayed name, or return -1. */
+static int
+prng_find(const char *arg)
+{
+    char *end;
+    long i = strtol(arg, &end, 10);
+    if (*arg && !*end)
+        return i >= 0 && i < NPRNGS ? i : -1;
+    for (int i = 0; i < NPRNGS; i++)
+        if (!strcmp(arg, prngs[i].id) || !strcmp(arg, prngs[i].name))
+            return i;
+    return -1;
+}
+
+#define NSTREAMS 4096      /* Streams spawned per -j sample */
+
+/* Measure how quickly each jumpable generator spawns NSTREAMS streams
+ * from one master seed. The one-time jump table setup is timed
+ * separately.
+ */
+static void
+spawn_bench(void)
+{
+    static uint64_t streams[NSTREAMS * 16];
+
+    printf("%-20s%16s%16s\n", "", "streams/s", "table ms");
+    for (int i = 0; i < NPRNGS; i++) {
+        if (!prngs[i].spawn)
+            continue;
+        int words = prngs[i].size / sizeof(uint64_t);
+        uint64_t master[16];
+        seed_words(master, 16, seed);
+
+        double start = now();
+        prngs[i].spawn(master);
+        double table = now() - start;
+
+        double best = 0;
+        for (int n = 0; n < NSAMPLES; n++) {
+            uint64_t s[16];
+            memcpy(s, master, sizeof(s));
+            start = now();
+            for (int j = 0; j < NSTREAMS; j++) {
+                memcpy(streams + j * words, s, words * sizeof(*s));
+                prngs[i].spawn(s);
+            }
+            double rate = NSTREAMS / (now() - start);
+            CLOBBER(streams);
+            if (rate > best)
+                best = rate;
+        }
+        printf("%-20s%16.0f%16.3f\n", prngs[i].name, best, table * 1e3);
+        fflush(stdout);
+    }
+}
+
+/* Measure per-entity construction for -i. Every generator is timed
+ * setting up a fresh instance and drawing its first output. States made
+ * of plain words are also timed seeding SEED_INSTANCES instances into
+ * an array, one seed_words() call at a time and then in bulk with
+ * seed_instances().
+ */
+static double
+instance_rate(uint64_t *states, int words, int bulk)
+{
+    double best = 0;
+    for (int n = 0; n < NSAMPLES; n++) {
+        double start = now();
+        if (bulk) {
+            seed_instances(states, SEED_INSTANCES, words, seed + n);
+        } else {
+            for (long i = 0; i < SEED_INSTANCES; i++)
+                seed_words(states + i * words, words, seed + n + i);
+        }
+        double rate = SEED_INSTANCES / (now() - start);
+        CLOBBER(states);
+        if (rate > best)
+            best = rate;
+    }
+    return best;
+}
+
+/* Random access for -e. Each counter-based engine is timed producing
+ * words sequentially, one scalar block at a time and with its bulk
+ * kernel, and then evaluating words at ACCESS_INDICES scattered
+ * positions, one cbrng_at() each. Its 64-bit word index reaches the
+ * first 2^64 words of the stream.
+ */
+#define ACCESS_INDICES 4096
+
+static double
+access_rate(struct cbrng *g, int mode, const uint64_t *indices)
+{
+    static uint64_t buf[ACCESS_INDICES];
+    double best = 0;
+    for (int i = 0; i < NSAMPLES; i++) {
+        running = 1;
+        unsigned long long c = 0;
+        uint64_t ctr = 0;
+        signal(SIGALRM, alarm_handler);
+        double start = now();
+        alarm(SECONDS);
+        while (running) {
+            switch (mode) {
+                case 0:
+                    for (int k = 0; k < ACCESS_INDICES; k += 4) {
+                        uint64_t x[4] = {ctr++, 0, 0, 0};
+                        g->e->block(x, g->key);
+                        SINK(x[0]);
+                        SINK(x[1]);
+                        SINK(x[2]);
+                        SINK(x[3]);
+                    }
+                    break;
+                case 1:
+                    cbrng_fill(g, buf, ACCESS_INDICES);
+                    CLOBBER(buf);
+                    break;
+                case 2:
+                    for (int k = 0; k < ACCESS_INDICES; k++)
+                        SINK(cbrng_at(g, indices[k]));
+                    break;
+            }
+            c += ACCESS_INDICES;
+        }
+        double rate = c / (now() - start);
+        if (rate > best)
+            best = rate;
+    }
+    return best;
+}
+
+static void
+access_bench(void)
+{
+    static uint64_t indices[ACCESS_INDICES];
+    uint64_t s = seed;
+    for (int i = 0; i < ACCESS_INDICES; i++)
+        indices[i] = splitmix64(&s);
+    struct cbrng g[1];
+    printf("%-20s%14s%14s%14s\n", "Mwords/s", "scalar", "bulk", "scattered");
+    for (int e = 0; e < CBRNG_NENGINES; e++) {
+        cbrng_init(g, cbrng_engines[e], seed);
+        printf("%-20s", cbrng_engines[e]->name);
+        for (int mode = 0; mode < 3; mode++) {
+            printf("%14.3f", access_rate(g, mode, indices) / 1e6);
+            fflush(stdout);
+        }
+        printf("  (%s)\n", g->isa);
+    }
+}
+
+/* Blowfish key setup for -i, in keys/s: REKEY_KEYS contexts keyed one
+ * blowfish_init() at a time, then all at once with blowfish_init_batch().
+ * Keys are 16 bytes, as in BLOWFISH_SETUP().
+ */
+#define REKEY_KEYS 1024
+
+static double
+rekey_rate(struct blowfish *ctx, int batch)
+{
+    static uint64_t keys[REKEY_KEYS * 2];
+    double best = 0;
+    for (int n = 0; n < NSAMPLES; n++) {
+        uint64_t s = seed + n;
+        splitmix64_fill(&s, keys, REKEY_KEYS * 2);
+        double start = now();
+        if (batch) {
+            blowfish_init_batch(ctx, keys, 16, REKEY_KEYS);
+        } else {
+            for (int i = 0; i < REKEY_KEYS; i++)
+                blowfish_init(ctx + i, keys + i * 2, 16);
+        }
+        double rate = REKEY_KEYS / (now() - start);
+        CLOBBER(ctx);
+        if (rate > best)
+            best = rate;
+    }
+    return best;
+}
+
+static void
+instance_bench(int g)
+{
+    uint64_t *states = malloc(SEED_INSTANCES * 16 * sizeof(*states));
+    if (!states) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("%-20s%16s%16s%16s\n", "instances/s",
+           "setup+draw", "one by one", "bulk");
+    for (int i = 0; i < NPRNGS; i++) {
+        if (g != -1 ? g != i : !i)
+            continue;
+        printf("%-20s%16.0f", prngs[i].name, prngs[i].construct());
+        fflush(stdout);
+        int words = prngs[i].words;
+        if (words)
+            printf("%16.0f%16.0f\n", instance_rate(states, words, 0),
+                   instance_rate(states, words, 1));
+        else
+            printf("%16s%16s\n", "-", "-");
+        fflush(stdout);
+    }
+    free(states);
+
+    if (g != -1 && strncmp(prngs[g].id, "blowfish", 8))
+        return;
+    struct blowfish *ctx = malloc(REKEY_KEYS * sizeof(*ctx));
+    if (!ctx) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("\n%-20s%16s%16s%16s\n", "keys/s", "", "one by one", "batch");
+    printf("%-20s%16s%16.0f", "blowfish", "", rekey_rate(ctx, 0));
+    fflush(stdout);
+    printf("%16.0f\n", rekey_rate(ctx, 1));
+    free(ctx);
+}
+
+/* NUMA placement of the -t and -b output, chosen with -n. A placement
+ * is a node number or one of these.
+ */
+#define PLACE_FIRST      ARENA_ANY         /* No policy, first touch */
+#define PLACE_INTERLEAVE ARENA_INTERLEAVE  /* Pages spread over nodes */
+#define PLACE_LOCAL      -3                /* Each thread's own node */
+#define MAXPLACES        64
+
+static void
+place_name(int place, char *buf, size_t len)
+{
+    if (place == PLACE_FIRST)
+        snprintf(buf, len, "first");
+    else if (place == PLACE_INTERLEAVE)
+        snprintf(buf, len, "interleave");
+    else if (place == PLACE_LOCAL)
+        snprintf(buf, len, "local");
+    else
+        snprintf(buf, len, "node%d", place);
+}
+
+/* Fill cpus with n CPUs, round-robin, to run threads on. Threads for a
+ * node placement stay on that node's CPUs unless it has none we may
+ * use, as with a memory-only node, in which case they run anywhere.
+ */
+static void
+place_cpus(int place, int *cpus, int n)
+{
+    cpu_set_t set, node;
+    sched_getaffinity(0, sizeof(set), &set);
+    if (place >= 0) {
+        arena_node_cpus(place, &node);
+        CPU_AND(&node, &node, &set);
+        if (CPU_COUNT(&node))
+            set = node;
+    }
+    int ncpus = 0;
+    for (int i = 0; ncpus < n && i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, &set))
+            cpus[ncpus++] = i;
+    for (int i = ncpus; i < n; i++)
+        cpus[i] = cpus[i % ncpus];
+}
+
+/* Pin the calling thread to one CPU for a single-threaded benchmark
+ * whose output is placed on a node, and return the node to bind that
+ * output to. Other placements leave the thread where it is.
+ */
+static int
+place_pin(int place)
+{
+    if (place == PLACE_LOCAL)
+        place = arena_cpu_node(sched_getcpu());
+    if (place >= 0) {
+        struct worker w;
+        place_cpus(place, &w.cpu, 1);
+        worker_pin(&w);
+    }
+    return place;
+}
+
+/* Parse a comma-separated list of page sizes for -y, or "all". Returns
+ * the number parsed, or 0 if any is invalid.
+ */
+static int
+parse_pages(char *arg, enum arena_pages *pages)
+{
+    int n = 0;
+    for (char *s = strtok(arg, ","); s; s = strtok(0, ",")) {
+        if (!strcmp(s, "all")) {
+            for (n = 0; n < ARENA_PAGES; n++)
+                pages[n] = n;
+            continue;
+        }
+        int y = 0;
+        while (y < ARENA_PAGES && strcmp(s, arena_pages_name[y]))
+            y++;
+        if (y == ARENA_PAGES || n == ARENA_PAGES)
+            return 0;
+        pages[n++] = y;
+    }
+    return n;
+}
+
+/* Parse a comma-separated list of placements for -n. "all" is first
+ * touch, local, interleave and then every online node.
+ */
+static int
+parse_places(char *arg, int *places)
+{
+    int n = 0;
+    for (char *s = strtok(arg, ","); s; s = strtok(0, ",")) {
+        int place;
+        char *end;
+        if (!strcmp(s, "all")) {
+            cpu_set_t nodes;
+            arena_nodes(&nodes);
+            n = 0;
+            places[n++] = PLACE_FIRST;
+            places[n++] = PLACE_LOCAL;
+            places[n++] = PLACE_INTERLEAVE;
+            for (int i = 0; n < MAXPLACES && i < CPU_SETSIZE; i++)
+                if (CPU_ISSET(i, &nodes))
+                    places[n++] = i;
+            continue;
+        } else if (!strcmp(s, "first")) {
+            place = PLACE_FIRST;
+        } else if (!strcmp(s, "local")) {
+            place = PLACE_LOCAL;
+        } else if (!strcmp(s, "interleave")) {
+            place = PLACE_INTERLEAVE;
+        } else {
+            long node = strtol(s, &end, 10);
+            if (!*s || *end || node < 0 || node >= ARENA_MAXNODES)
+                return 0;
+            place = node;
+        }
+        if (n == MAXPLACES)
+            return 0;
+        places[n++] = place;
+    }
+    return n;
+}
+
+/* Print the header line for one page size and placement. */
+static void
+layout_begin(enum arena_pages pages, int place, int first)
+{
+    char name[16];
+    place_name(place, name, sizeof(name));
+    printf("%spages %s, placement %s\n", first ? "" : "\n",
+           arena_pages_name[pages], name);
+    fflush(stdout);
+}
+
+/* Run NSAMPLES rounds of nthreads concurrent workers and report the
+ * best aggregate round, along with its slowest and fastest thread.
+ * Worker seeds are drawn like the -r producers', so the threads run
+ * independent streams. Returns 0 with errno set if the output arena
+ * cannot be set up.
+ */
+static int
+scaling(const char *name, void *(*thread)(void *), int nthreads, int *cpus,
+        enum arena_pages pages, int place)
+{
+    static struct worker workers[MAXTHREADS];
+    unsigned long long slice = N;
+    while (slice * nthreads > N)
+        slice /= 2;
+
+    /* Bind each slice before faulting the whole arena in */
+    struct arena arena;
+    size_t bytes = slice * sizeof(uint64_t);
+    if (!arena_map(&arena, bytes * nthreads, pages))
+        return 0;
+    for (int i = 0; i < nthreads; i++) {
+        int node = place == PLACE_LOCAL ? arena_cpu_node(cpus[i]) : place;
+        if (!arena_bind(&arena, i * bytes, bytes, node)) {
+            int err = errno;
+            arena_free(&arena);
+            errno = err;
+            return 0;
+        }
+    }
+    if (!arena_fault(&arena)) {
+        int err = errno;
+        arena_free(&arena);
+        errno = err;
+        return 0;
+    }
+
+    unsigned long long best = 0, lo = 0, hi = 0;
+    for (int s = 0; s < NSAMPLES; s++) {
+        pthread_barrier_t start;
+        pthread_barrier_init(&start, 0, nthreads + 1);
+        running = 1;
+        uint64_t seeds = seed;
+        for (int i = 0; i < nthreads; i++) {
+            struct worker *w = workers + i;
+            w->start = &start;
+            w->out = (uint64_t *)arena.base + i * slice;
+            w->mask = slice - 1;
+            w->count = 0;
+            w->seed = i ? splitmix64(&seeds) : seed;
+            w->cpu = cpus[i];
+            pthread_create(&w->thread, 0, thread, w);
+        }
+        signal(SIGALRM, alarm_handler);
+        pthread_barrier_wait(&start);
+        alarm(SECONDS);
+
+        unsigned long long total = 0;
+        unsigned long long min = -1, max = 0;
+        for (int i = 0; i < nthreads; i++) {
+            pthread_join(workers[i].thread, 0);
+            unsigned long long c = workers[i].count;
+            total += c;
+            min = c < min ? c : min;
+            max = c > max ? c : max;
+        }
+        pthread_barrier_destroy(&start);
+        if (total > best) {
+            best = total;
+            lo = min;
+            hi = max;
+        }
+    }
+
+    double scale = 8.0 / SECONDS / 1024.0 / 1024.0;
+    printf("%-20s%3d  %12.3f MB/s  %10.3f MB/s/thread  [%.3f, %.3f]\n",
+           name, nthreads, scale * best, scale * best / nthreads,
+           scale * lo, scale * hi);
+    fflush(stdout);
+    arena_free(&arena);
+    return 1;
+}
+
+/* Quality battery for -q. Every (generator, test) pair is a job, and a
+ * pool of threads takes jobs from a shared counter, each job running
+ * its test against a fresh generator state.
+ */
+struct qjob {
+    void (*check)(const struct qtest *, void *);
+    const struct qtest *test;
+    double p;
+};
+
+static struct {
+    struct qjob *jobs;
+    int njobs;
+    int next;
+} qpool;
+
+static void *
+quality_worker(void *arg)
+{
+    (void)arg;
+    int i;
+    while ((i = __atomic_fetch_add(&qpool.next, 1, __ATOMIC_RELAXED)) <
+           qpool.njobs) {
+        struct qjob *j = qpool.jobs + i;
+        void *qs = calloc(1, j->test->size);
+        if (!qs) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        j->check(j->test, qs);
+        j->p = j->test->pvalue(qs);
+        free(qs);
+    }
+    return 0;
+}
+
+static void
+quality(struct qjob *jobs, int njobs, int nthreads)
+{
+    static pthread_t threads[MAXTHREADS];
+    qpool.jobs = jobs;
+    qpool.njobs = njobs;
+    qpool.next = 0;
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(threads + i, 0, quality_worker, 0);
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], 0);
+}
+
+/* Random number server for -r, and its consumer benchmark for -a. The
+ * first producer is seeded like every other mode, so a single-producer
+ * server hands out the same stream as -g. Further producers take their
+ * seeds from the splitmix64 stream of the seed.
+ */
+static struct producer producers[RING_MAXQ];
+
+static void
+serve_start(struct ring *r, void *(*serve)(void *), int n)
+{
+    uint64_t s = seed;
+    for (int i = 0; i < n; i++) {
+        struct producer *p = producers + i;
+        p->ring = r;
+        p->queue = r->q + i;
+        p->seed = i ? splitmix64(&s) : seed;
+        p->blocks = 0;
+        pthread_create(&p->thread, 0, serve, p);
+    }
+}
+
+/* Stop the producers and return the number of blocks they published. */
+static unsigned long long
+serve_stop(struct ring *r, int n)
+{
+    unsigned long long blocks = 0;
+    ring_stop(r);
+    for (int i = 0; i < n; i++) {
+        pthread_join(producers[i].thread, 0);
+        blocks += producers[i].blocks;
+    }
+    return blocks;
+}
+
+static struct ring *
+serve_create(const char *name, int n, const char *generator)
+{
+    struct ring *r = ring_create(name, n, generator);
+    if (!r) {
+        fprintf(stderr, "could not create ring %s: %s\n",
+                name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return r;
+}
+
+/* Serve generator g on the named ring until interrupted. */
+static void
+serve(int g, const char *name, int n)
+{
+    struct ring *r = serve_create(name, n, prngs[g].name);
+    running = 1;
+    signal(SIGINT, alarm_handler);
+    signal(SIGTERM, alarm_handler);
+    double start = now();
+    serve_start(r, prngs[g].serve, n);
+    fprintf(stderr, "serving %s on %s, %d producer%s, %zu KiB\n",
+            prngs[g].name, name, n, n > 1 ? "s" : "", ring_size(n) >> 10);
+    while (running)
+        sleep(1);  /* Cut short by the signal */
+    unsigned long long blocks = serve_stop(r, n);
+    ring_destroy(r, name);
+    double elapsed = now() - start;
+    double mb = blocks * (RING_WORDS * 8 / 1024.0 / 1024.0);
+    fprintf(stderr, "served %.0f MB in %.3f s, %.3f MB/s\n",
+            mb, elapsed, mb / elapsed);
+}
+
+/* Per-thread context for a benchmark consumer. Each consumer attaches
+ * on its own, as a separate process would, and times every block claim
+ * in TSC ticks, including any wait for a producer.
+ */
+struct consumer {
+    pthread_t thread;
+    pthread_barrier_t *start;
+    const char *name;
+    unsigned long long words;
+    struct hist hist;
+};
+
+static void *
+consumer(void *arg)
+{
+    struct consumer *c = arg;
+    struct ring_client rc;
+    if (!ring_attach(&rc, c->name)) {
+        fprintf(stderr, "could not attach to %s: %s\n",
+                c->name, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_wait(c->start);
+    while (running) {
+        uint64_t t0 = tsc_start();
+        if (!ring_refill(&rc))
+            break;
+        uint64_t t1 = tsc_stop();
+        hist_add(&c->hist, t1 - t0);
+        CLOBBER(rc.buf);
+        c->words += RING_WORDS;
+    }
+    ring_detach(&rc);
+    return 0;
+}
+
+/* Consumer throughput and claim latency with nproducers producers and
+ * from one up to maxconsumers consumers contending for their queues.
+ */
+static void
+ring_bench(int g, int maxconsumers, int nproducers)
+{
+    static struct consumer consumers[MAXTHREADS];
+    static struct hist all;
+    char name[32];
+    snprintf(name, sizeof(name), "/shootout-%ld", (long)getpid());
+    uint64_t overhead = tsc_overhead();
+
+    printf("TSC ticks per %d-word claim, timer overhead %llu subtracted\n",
+           RING_WORDS, (unsigned long long)overhead);
+    printf("%-20s%4s%4s%12s%12s%10s%10s%10s%12s\n", "", "P", "C",
+           "MB/s", "MB/s/cons", "p50", "p99", "p99.9", "max");
+    for (int i = 0; i < NPRNGS; i++) {
+        if (g != -1 && g != i)
+            continue;
+        for (int n = 1; ; n = n * 2 < maxconsumers ? n * 2 : maxconsumers) {
+            struct ring *r = serve_create(name, nproducers, prngs[i].name);
+            serve_start(r, prngs[i].serve, nproducers);
+
+            pthread_barrier_t start;
+            pthread_barrier_init(&start, 0, n + 1);
+            running = 1;
+            for (int c = 0; c < n; c++) {
+                struct consumer *w = consumers + c;
+                w->start = &start;
+                w->name = name;
+                w->words = 0;
+                memset(&w->hist, 0, sizeof(w->hist));
+                w->hist.overhead = overhead;
+                pthread_create(&w->thread, 0, consumer, w);
+            }
+            signal(SIGALRM, alarm_handler);
+            pthread_barrier_wait(&start);
+            double begin = now();
+            alarm(SECONDS);
+
+            unsigned long long words = 0;
+            memset(&all, 0, sizeof(all));
+            for (int c = 0; c < n; c++) {
+                struct consumer *w = consumers + c;
+                pthread_join(w->thread, 0);
+                words += w->words;
+                for (int b = 0; b < HIST_BUCKETS; b++)
+                    all.count[b] += w->hist.count[b];
+                all.n += w->hist.n;
+                all.max = w->hist.max > all.max ? w->hist.max : all.max;
+            }
+            double elapsed = now() - begin;
+            pthread_barrier_destroy(&start);
+            serve_stop(r, nproducers);
+            ring_destroy(r, name);
+
+            double mbps = words * 8 / elapsed / 1024.0 / 1024.0;
+            printf("%-20s%4d%4d%12.3f%12.3f%10llu%10llu%10llu%12llu\n",
+                   prngs[i].name, nproducers, n, mbps, mbps / n,
+                   (unsigned long long)hist_quantile(&all, 0.5),
+                   (unsigned long long)hist_quantile(&all, 0.99),
+                   (unsigned long long)hist_quantile(&all, 0.999),
+                   (unsigned long long)all.max);
+            fflush(stdout);
+            if (n == maxconsumers)
+                break;
+        }
+    }
+}
+
+/* Result output for the default throughput sweep */
+#ifndef SHOOTOUT_CFLAGS
+#  define SHOOTOUT_CFLAGS "unknown"
+#endif
+#if defined(__clang__)
+#  define SHOOTOUT_COMPILER "clang " __clang_version__
+#elif defined(__GNUC__)
+#  define SHOOTOUT_COMPILER "gcc " __VERSION__
+#else
+#  define SHOOTOUT_COMPILER "unknown"
+#endif
+
+enum format {FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV};
+
+static void
+cpu_model(char *buf, size_t len)
+{
+    snprintf(buf, len, "unknown");
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        if (!strncmp(line, "model name", 10) && colon) {
+            colon += 1 + (colon[1] == ' ');
+            colon[strcspn(colon, "\n")] = 0;
+            snprintf(buf, len, "%s", colon);
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static void
+json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static void
+csv_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"')
+            putchar('"');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+/* Per-word hardware counts for -p, with instructions per cycle first.
+ * Events that were not counted print as "-", null or an empty field.
+ */
+static void
+report_counters(enum format format, const struct counters *c)
+{
+    double v[1 + COUNTER_COUNT];
+    double cy = counters_per_word(c, COUNTER_CYCLES);
+    double in = counters_per_word(c, COUNTER_INSTRUCTIONS);
+    v[0] = cy > 0 && in >= 0 ? in / cy : -1;
+    for (int e = 0; e < COUNTER_COUNT; e++)
+        v[1 + e] = counters_per_word(c, e);
+    for (int i = 0; i < 1 + COUNTER_COUNT; i++) {
+        const char *key = i ? counter_name[i - 1] : "ipc";
+        switch (format) {
+            case FORMAT_TEXT:
+                if (i == 1 + COUNTER_CYCLES)
+                    continue;  /* Beside cycles/word, only as IPC */
+                if (v[i] < 0)
+                    printf("%10s", "-");
+                else
+                    printf("%10.3f", v[i]);
+                break;
+            case FORMAT_JSON:
+                printf("%s\"%s\": ", i ? ", " : ", \"counters\": {", key);
+                if (v[i] < 0)
+                    printf("null");
+                else
+                    printf("%.4f", v[i]);
+                if (i == COUNTER_COUNT)
+                    putchar('}');
+                break;
+            case FORMAT_CSV:
+                putchar(',');
+                if (v[i] >= 0)
+                    printf("%.4f", v[i]);
+                break;
+        }
+    }
+}
+
+static void
+report_begin(enum format format, enum timing timing, const struct adapt *a,
+             const struct counters *c)
+{
+    char cpu[256];
+    cpu_model(cpu, sizeof(cpu));
+    switch (format) {
+        case FORMAT_TEXT:
+            printf("%-20s%12s", "", "MB/s");
+            if (a)
+                printf("%8s%5s", "+/-%", "n");
+            printf("%12s%12s", "ns/word", "cycles/word");
+            if (c) {
+                printf("%10s", "IPC");
+                for (int e = 0; e < COUNTER_COUNT; e++)
+                    if (e != COUNTER_CYCLES)
+                        printf("%10s", counter_name[e]);
+            }
+#ifdef SHOOTOUT_ISA
+            printf("  (%s, %s)\n", timing_name[timing], isa_name(ISA_THIS));
+#else
+            printf("  (%s)\n", timing_name[timing]);
+#endif
+            break;
+        case FORMAT_JSON:
+            printf("{\n  \"cpu\": ");
+            json_string(cpu);
+            printf(",\n  \"compiler\": ");
+            json_string(SHOOTOUT_COMPILER);
+            printf(",\n  \"cflags\": ");
+            json_string(SHOOTOUT_CFLAGS);
+#ifdef SHOOTOUT_ISA
+            printf(",\n  \"isa\": \"%s\"", isa_name(ISA_THIS));
+#else
+            printf(",\n  \"isa\": null");
+#endif
+            if (a)
+                printf(",\n  \"seconds\": %g,\n  \"nsamples\": null,\n"
+                       "  \"target\": %g,\n  \"budget\": %g",
+                       ADAPT_SECONDS, 100 * a->target, a->budget);
+            else
+                printf(",\n  \"seconds\": %d,\n  \"nsamples\": %d",
+                       SECONDS, NSAMPLES);
+            printf(",\n  \"timing\": \"%s\",\n  \"results\": [\n",
+                   timing_name[timing]);
+            break;
+        case FORMAT_CSV:
+            printf("name,seconds,min,median,max,ns,cycles");
+            if (a)
+                printf(",ci,nsamples,discarded");
+            if (c) {
+                printf(",ipc");
+                for (int e = 0; e < COUNTER_COUNT; e++)
+                    printf(",%s", counter_name[e]);
+            }
+            /* Adaptive runs keep a varying number of samples */
+            for (int i = 0; !a && i < NSAMPLES; i++)
+                printf(",sample%d", i);
+            printf(",cpu,compiler,cflags\n");
+            break;
+    }
+}
+
+/* Print one generator's samples, given in ns and TSC cycles per word,
+ * with throughput in MB/s, and its counters if c is given. Adaptive
+ * samples also carry the median's confidence interval, in percent.
+ * Each JSON result is kept on a single line so that compare mode can
+ * read it back line by line.
+ */
+static void
+report(enum format format, const char *name, int first,
+       const struct samples *s, const struct counters *c)
+{
+    double samples[MAXSAMPLES];
+    for (int i = 0; i < s->n; i++)
+        samples[i] = timing_mbps(s->ns[i]);
+    double sorted[MAXSAMPLES];
+    memcpy(sorted, samples, s->n * sizeof(*sorted));
+    qsort(sorted, s->n, sizeof(*sorted), cmp_double);
+    double min = sorted[0];
+    double max = sorted[s->n - 1];
+    double med = median(samples, s->n);
+    double nsmed = median(s->ns, s->n);
+    double cymed = median(s->cycles, s->n);
+    double ci = 100 * s->ci;
+
+    switch (format) {
+        case FORMAT_TEXT:
+            printf("%-20s%12.3f", name, med);
+            if (s->ci >= 0)
+                printf("%8.2f%5d", ci, s->n);
+            printf("%12.3f%12.3f", nsmed, cymed);
+            if (c)
+                report_counters(format, c);
+            putchar('\n');
+            break;
+        case FORMAT_JSON:
+            printf("%s    {\"name\": \"%s\", \"min\": %.3f, "
+                   "\"median\": %.3f, \"max\": %.3f, \"ns\": %.4f, "
+                   "\"cycles\": %.4f, ",
+                   first ? "" : ",\n", name, min, med, max, nsmed, cymed);
+            if (s->ci >= 0)
+                printf("\"ci\": %.3f, \"discarded\": %d, ",
+                       ci, s->discarded);
+            printf("\"samples\": [");
+            for (int i = 0; i < s->n; i++)
+                printf("%s%.3f", i ? ", " : "", samples[i]);
+            putchar(']');
+            if (c)
+                report_counters(format, c);
+            putchar('}');
+            break;
+        case FORMAT_CSV: {
+            char cpu[256];
+            cpu_model(cpu, sizeof(cpu));
+            printf("%s,%g,%.3f,%.3f,%.3f,%.4f,%.4f", name, s->seconds,
+                   min, med, max, nsmed, cymed);
+            if (s->ci >= 0)
+                printf(",%.3f,%d,%d", ci, s->n, s->discarded);
+            if (c)
+                report_counters(format, c);
+            for (int i = 0; s->ci < 0 && i < s->n; i++)
+                printf(",%.3f", samples[i]);
+            putchar(',');
+            csv_string(cpu);
+            putchar(',');
+            csv_string(SHOOTOUT_COMPILER);
+            putchar(',');
+            csv_string(SHOOTOUT_CFLAGS);
+            putchar('\n');
+        } break;
+    }
+    fflush(stdout);
+}
+
+static void
+report_end(enum format format)
+{
+    if (format == FORMAT_JSON)
+        printf("\n  ]\n}\n");
+}
+
+#define MAXRESULTS 256
+
+struct results {
+    int n;
+    char name[MAXRESULTS][24];
+    double median[MAXRESULTS];
+};
+
+/* Load the medians from a JSON or CSV file written by -o. */
+static int
+results_load(struct results *r, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    char line[4096];
+    r->n = 0;
+    while (r->n < MAXRESULTS && fgets(line, sizeof(line), f)) {
+        char *name = r->name[r->n];
+        double *median = r->median + r->n;
+        char *p = strstr(line, "\"name\": \"");
+        char *m = strstr(line, "\"median\": ");
+        if (p && m) {
+            if (sscanf(p + 9, "%23[^\"]", name) == 1 &&
+                sscanf(m + 10, "%lf", median) == 1)
+                r->n++;
+        } else if (strncmp(line, "name,", 5) && !strchr(line, '{')) {
+            if (sscanf(line, "%23[^,],%*[^,],%*[^,],%lf", name, median) == 2)
+                r->n++;
+        }
+    }
+    fclose(f);
+    return 1;
+}
+
+/* Compare median throughput between two result files, flagging changes
+ * beyond threshold percent. Returns the number of regressions.
+ */
+static int
+compare(const char *oldpath, const char *newpath, double threshold)
+{
+    static struct results old, new;
+    if (!results_load(&old, oldpath) || !results_load(&new, newpath)) {
+        fprintf(stderr, "could not read %s or %s\n", oldpath, newpath);
+        exit(EXIT_FAILURE);
+    }
+    int regressions = 0;
+    printf("%-20s%14s%14s%10s\n", "MB/s (median)", "old", "new", "change");
+    for (int i = 0; i < new.n; i++) {
+        int j = 0;
+        while (j < old.n && strcmp(old.name[j], new.name[i]))
+            j++;
+        if (j == old.n) {
+            printf("%-20s%14s%14.3f%10s\n", new.name[i], "-",
+                   new.median[i], "new");
+            continue;
+        }
+        double change = 100 * (new.median[i] - old.median[j]) / old.median[j];
+        const char *flag = "";
+        if (change < -threshold) {
+            flag = "  SLOWER";
+            regressions++;
+        } else if (change > threshold) {
+            flag = "  FASTER";
+        }
+        printf("%-20s%14.3f%14.3f%+9.1f%%%s\n", new.name[i],
+               old.median[j], new.median[i], change, flag);
+    }
+    for (int j = 0; j < old.n; j++) {
+        int i = 0;
+        while (i < new.n && strcmp(old.name[j], new.name[i]))
+            i++;
+        if (i == new.n)
+            printf("%-20s%14.3f%14s%10s\n", old.name[j], old.median[j],
+                   "-", "missing");
+    }
+    return regressions;
+}
+
+int
+main(int argc, char **argv)
+{
+
+    /* Options */
+    int g = -1;
+    int t = 0;
+    int b = 0;
+    int j = 0;
+    int l = 0;
+    int q = 0;
+    int z = 0;
+    int inst = 0;
+    int k = 0;
+    int p = 0;
+    int a = 0;
+    int e = 0;
+    int isa = -1;
+    const char *ring = 0;
+    enum arena_pages pages[ARENA_PAGES] = {ARENA_4K};
+    int npages = 1;
+    int places[MAXPLACES] = {PLACE_FIRST};
+    int nplaces = 1;
+    enum timing timing = TIMING_THROUGHPUT;
+    uint64_t u = 0;
+    enum format format = FORMAT_TEXT;
+    const char *baseline = 0;
+    double threshold = 5.0;
+    struct adapt adapt = {0, ADAPT_BUDGET};
 
     int option;
-    while ((option = getopt(argc, argv, "g:h")) != -1) {
+    const char *options = "a:bc:d:ef:g:hijklm:n:o:pqr:s:t:u:w:x:y:z";
+    while ((option = getopt(argc, argv, options)) != -1) {
         switch (option) {
+            case 'a':
+                a = atoi(optarg);
+                if (a < 1 || a > MAXTHREADS) {
+                    fprintf(stderr, "invalid -a argument: %d\n", a);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                b = 1;
+                break;
+            case 'd':
+                adapt.target = atof(optarg) / 100;
+                if (adapt.target <= 0) {
+                    fprintf(stderr, "invalid -d argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'e':
+                e = 1;
+                break;
+            case 'f':
+                isa = isa_find(optarg);
+                if (isa == -1) {
+                    fprintf(stderr, "invalid -f argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case 'g':
-                g = atoi(optarg);
-                if (g < 0 || g > nprngs) {
-                    fprintf(stderr, "invalid -g argument: %d\n", g);
+                g = prng_find(optarg);
+                if (g == -1) {
+                    fprintf(stderr, "invalid -g argument: %s\n", optarg);
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'c':
+                baseline = optarg;
+                break;
+            case 'i':
+                inst = 1;
+                break;
+            case 'j':
+                j = 1;
+                break;
+            case 'k':
+                k = 1;
+                break;
+            case 'l':
+                l = 1;
+                break;
+            case 'p':
+                p = 1;
+                break;
+            case 'q':
+                q = 1;
+                break;
+            case 'r':
+                ring = optarg;
+                break;
+            case 's': {
+                char *end;
+                errno = 0;
+                seed = strtoull(optarg, &end, 0);
+                if (!*optarg || *end || errno) {
+                    fprintf(stderr, "invalid -s argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+            } break;
+            case 't':
+                t = atoi(optarg);
+                if (t < 1 || t > MAXTHREADS) {
+                    fprintf(stderr, "invalid -t argument: %d\n", t);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                if (!strcmp(optarg, "throughput")) {
+                    timing = TIMING_THROUGHPUT;
+                } else if (!strcmp(optarg, "latency")) {
+                    timing = TIMING_LATENCY;
+                } else {
+                    fprintf(stderr, "invalid -m argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                nplaces = parse_places(optarg, places);
+                if (!nplaces) {
+                    fprintf(stderr, "invalid -n argument\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'o':
+                if (!strcmp(optarg, "text")) {
+                    format = FORMAT_TEXT;
+                } else if (!strcmp(optarg, "json")) {
+                    format = FORMAT_JSON;
+                } else if (!strcmp(optarg, "csv")) {
+                    format = FORMAT_CSV;
+                } else {
+                    fprintf(stderr, "invalid -o argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'u':
+                u = strtoull(optarg, 0, 10);
+                if (!u) {
+                    fprintf(stderr, "invalid -u argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                adapt.budget = atof(optarg);
+                if (adapt.budget <= 0) {
+                    fprintf(stderr, "invalid -w argument: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'x':
+                threshold = atof(optarg);
+                break;
+            case 'y':
+                npages = parse_pages(optarg, pages);
+                if (!npages) {
+                    fprintf(stderr, "invalid -y argument\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'z':
+                z = 1;
+                break;
             case 'h':
-                puts("speedtest [-g n] [-h]");
-                for (int i = 0; i < nprngs; i++)
-                    printf("%-2d %s\n", i, prngs[i].name);
+                puts("speedtest [-b] [-e] [-f level] [-g n|name] [-h] [-i] "
+                     "[-j] [-k] [-l]\n"
+                     "          [-m throughput|latency] [-n placement,...] "
+                     "[-o text|json|csv] [-p]\n"
+                     "          [-q] [-s seed] [-t n] [-u range] "
+                     "[-y 4k|thp|2m|1g,...] [-z]\n"
+                     "speedtest -d percent [-w seconds] "
+                     "[-m throughput|latency] [-o text|json|csv] [-p]\n"
+                     "speedtest -r name -g n|name [-s seed] [-t producers]\n"
+                     "speedtest -a consumers [-g n|name] [-t producers]\n"
+                     "speedtest -c old [-x percent] new");
+#ifdef SHOOTOUT_ISA
+                printf("-f levels:");
+                for (int i = 0; i < ISA_COUNT; i++)
+                    printf(" %s%s", isa_suffix(i),
+                           i == ISA_THIS ? " (running)" :
+                           isa_supported(i) ? "" : " (unsupported)");
+                putchar('\n');
+#endif
+                for (int i = 0; i < NPRNGS; i++)
+                    printf("%-2d %-22s%-16s%6zu bytes%s\n", i, prngs[i].name,
+                           prngs[i].id, prngs[i].size,
+                           prngs[i].spawn ? ", jumps" : "");
                 exit(EXIT_SUCCESS);
             default:
                 exit(EXIT_FAILURE);
         }
     }
 
-    if (g != -1) {
+    /* Hand over to another level's copy, which parses the options anew */
+    if (isa != -1 && isa != ISA_THIS) {
+#ifdef SHOOTOUT_ISA
+        optind = 1;
+        return isa_run(isa, argc, argv);
+#else
+        fprintf(stderr, "-f requires a build with every ISA level\n");
+        exit(EXIT_FAILURE);
+#endif
+    }
+
+    if (baseline) {
+        if (optind != argc - 1) {
+            fprintf(stderr, "-c requires a new results file\n");
+            exit(EXIT_FAILURE);
+        }
+        return compare(baseline, argv[optind], threshold) ? 2 : 0;
+    } else if (ring) {
+        if (g == -1) {
+            fprintf(stderr, "-r requires a generator, -g\n");
+            exit(EXIT_FAILURE);
+        }
+        serve(g, ring, t ? t : 1);
+    } else if (a) {
+        ring_bench(g, a, t ? t : 1);
+    } else if (e) {
+        access_bench();
+    } else if (inst) {
+        instance_bench(g);
+    } else if (j) {
+        spawn_bench();
+    } else if (k) {
+        printf("%-20s%12s", "MB/s", "x1");
+        for (int n = 2; n <= ILP_MAXK; n *= 2) {
+            char label[8];
+            snprintf(label, sizeof(label), "x%d", n);
+            printf("%11s%7s", label, "gain");
+        }
+        putchar('\n');
+        for (int i = 0; i < NPRNGS; i++) {
+            if (g != -1 && g != i)
+                continue;
+            double one = prngs[i].ilp(1);
+            if (!one)
+                continue;  /* Not interleavable */
+            printf("%-20s%12.3f", prngs[i].name, timing_mbps(1e9 / one));
+            fflush(stdout);
+            for (int n = 2; n <= ILP_MAXK; n *= 2) {
+                double rate = prngs[i].ilp(n);
+                printf("%11.3f%6.2fx", timing_mbps(1e9 / rate), rate / one);
+                fflush(stdout);
+            }
+            putchar('\n');
+        }
+    } else if (l) {
+        static struct hist call, batch;
+        uint64_t overhead = tsc_overhead();
+        printf("TSC ticks, timer overhead %llu subtracted\n",
+               (unsigned long long)overhead);
+        printf("%-20s%8s%8s%8s%10s  |%8s%8s%8s%10s\n", "",
+               "p50", "p99", "p99.9", "max",
+               "p50", "p99", "p99.9", "max/64");
+        for (int i = 0; i < NPRNGS; i++) {
+            if (g != -1 && g != i)
+                continue;
+            memset(&call, 0, sizeof(call));
+            memset(&batch, 0, sizeof(batch));
+            call.overhead = batch.overhead = overhead;
+            prngs[i].latency(&call, &batch);
+            printf("%-20s%8llu%8llu%8llu%10llu  |", prngs[i].name,
+                   (unsigned long long)hist_quantile(&call, 0.5),
+                   (unsigned long long)hist_quantile(&call, 0.99),
+                   (unsigned long long)hist_quantile(&call, 0.999),
+                   (unsigned long long)call.max);
+            printf("%8.1f%8.1f%8.1f%10.1f\n",
+                   hist_quantile(&batch, 0.5) / (double)LAT_BATCH,
+                   hist_quantile(&batch, 0.99) / (double)LAT_BATCH,
+                   hist_quantile(&batch, 0.999) / (double)LAT_BATCH,
+                   batch.max / (double)LAT_BATCH);
+            fflush(stdout);
+        }
+    } else if (q) {
+        static struct qjob jobs[NPRNGS * NQTESTS];
+        int njobs = 0;
+        for (int i = 0; i < NPRNGS; i++) {
+            if (g != -1 ? g != i : !i)
+                continue;  /* The baseline only on request */
+            for (int k = 0; k < NQTESTS; k++) {
+                jobs[njobs].check = prngs[i].check;
+                jobs[njobs++].test = qtests + k;
+            }
+        }
+        cpu_set_t set;
+        sched_getaffinity(0, sizeof(set), &set);
+        int nthreads = CPU_COUNT(&set);
+        nthreads = nthreads < MAXTHREADS ? nthreads : MAXTHREADS;
+        quality(jobs, njobs, nthreads);
+
+        printf("%-20s", "p-value");
+        for (int k = 0; k < NQTESTS; k++)
+            printf("%12s", qtests[k].name);
+        putchar('\n');
+        for (int i = 0, n = 0; n < njobs; i++) {
+            if (g != -1 ? g != i : !i)
+                continue;
+            printf("%-20s", prngs[i].name);
+            for (int k = 0; k < NQTESTS; k++, n++) {
+                double p = jobs[n].p;
+                printf("%11.3g%c", p, p < QUALITY_FAIL ? '!' :
+                                      p < QUALITY_SUSPECT ? '?' : ' ');
+            }
+            putchar('\n');
+        }
+        printf("? p < %g, ! p < %g\n", QUALITY_SUSPECT, QUALITY_FAIL);
+    } else if (u) {
+        printf("%-20s%-10s%14s%12s%14s%12s\n", "", "",
+               "scalar Mv/s", "MB/s", "bulk Mv/s", "MB/s");
+        /* Skip the baseline, whose zeros are always rejected */
+        for (int i = 1; i < NPRNGS; i++) {
+            if (g != -1 && g != i)
+                continue;
+            for (int c = 0; c < CONVERT_COUNT; c++) {
+                double scalar = prngs[i].convert(c, 0, u);
+                double bulk = prngs[i].convert(c, 1, u);
+                double mb = convert_size[c] / 1024.0 / 1024.0;
+                printf("%-20s%-10s%14.3f%12.3f%14.3f%12.3f\n",
+                       prngs[i].name, convert_name[c],
+                       scalar / 1e6, scalar * mb, bulk / 1e6, bulk * mb);
+                fflush(stdout);
+            }
+        }
+    } else if (z) {
+        zig_init();
+        printf("%-20s%-10s%14s%14s\n", "", "", "scalar Ms/s", "bulk Ms/s");
+        for (int i = 0; i < NPRNGS; i++) {
+            if (g != -1 && g != i)
+                continue;
+            for (int d = 0; d < ZIGGURAT_COUNT; d++) {
+                double scalar = prngs[i].ziggurat(d, 0);
+                double bulk = prngs[i].ziggurat(d, 1);
+                printf("%-20s%-10s%14.3f%14.3f\n", prngs[i].name,
+                       ziggurat_name[d], scalar / 1e6, bulk / 1e6);
+                fflush(stdout);
+            }
+        }
+    } else if (t) {
+        /* Pin workers round-robin across the CPUs we may run on */
+        int first = 1;
+        for (int y = 0; y < npages; y++) {
+            for (int x = 0; x < nplaces; x++) {
+                int cpus[MAXTHREADS];
+                place_cpus(places[x], cpus, t);
+                layout_begin(pages[y], places[x], first);
+                first = 0;
+                for (int i = 0; i < NPRNGS; i++) {
+                    if (g != -1 && g != i)
+                        continue;
+                    int n = 1;
+                    while (n <= t && scaling(prngs[i].name, prngs[i].thread,
+                                             n, cpus, pages[y], places[x]))
+                        n++;
+                    if (n <= t) {
+                        fprintf(stderr, "cannot set up %s pages: %s\n",
+                                arena_pages_name[pages[y]], strerror(errno));
+                        break;
+                    }
+                }
+            }
+        }
+    } else if (b) {
+        cpu_set_t affinity;
+        sched_getaffinity(0, sizeof(affinity), &affinity);
+        int first = 1;
+        for (int y = 0; y < npages; y++) {
+            for (int x = 0; x < nplaces; x++) {
+                struct arena arena;
+                layout_begin(pages[y], places[x], first);
+                first = 0;
+                int node = place_pin(places[x]);
+                if (!arena_alloc(&arena, blocks[NBLOCKS - 1], pages[y],
+                                 node)) {
+                    fprintf(stderr, "cannot set up %s pages: %s\n",
+                            arena_pages_name[pages[y]], strerror(errno));
+                    sched_setaffinity(0, sizeof(affinity), &affinity);
+                    continue;
+                }
+                uint64_t *buf = arena.base;
+                printf("%-20s%12s", "MB/s", "per-call");
+                for (int j = 0; j < NBLOCKS; j++)
+                    printf("%12s", blocks_name[j]);
+                putchar('\n');
+                struct samples s;
+                samples_init(&s, SECONDS);
+                prngs[0].bench(timing, &s, NSAMPLES);
+                double overhead = median(s.ns, s.n);
+                for (int i = 0; i < NPRNGS; i++) {
+                    if (g != -1 && g != i)
+                        continue;
+                    double rates[NBLOCKS];
+                    samples_init(&s, SECONDS);
+                    prngs[i].bench(timing, &s, NSAMPLES);
+                    if (i)
+                        timing_correct(s.ns, s.n, overhead);
+                    printf("%-20s%12.3f", prngs[i].name,
+                           timing_mbps(median(s.ns, s.n)));
+                    fflush(stdout);
+                    prngs[i].blocks(buf, rates);
+                    for (int j = 0; j < NBLOCKS; j++)
+                        printf("%12.3f", rates[j]);
+                    putchar('\n');
+                    fflush(stdout);
+                }
+                arena_free(&arena);
+                sched_setaffinity(0, sizeof(affinity), &affinity);
+            }
+        }
+    } else if (g != -1) {
         prngs[g].pump();
     } else {
-        for (int i = 0; i < nprngs; i++)
-            prngs[i].bench();
+        const struct counters *pc = 0;
+        if (p) {
+            if (counters_open(&counters))
+                pc = &counters;
+            else
+                fprintf(stderr, "performance counters unavailable: %s\n",
+                        strerror(errno));
+        }
+        const struct adapt *pa = adapt.target ? &adapt : 0;
+        report_begin(format, timing, pa, pc);
+        struct samples s;
+        double nsover = 0, cyover = 0;
+        for (int i = 0; i < NPRNGS; i++) {
+            counters_clear(&counters);
+            samples_init(&s, SECONDS);
+            if (pa)
+                adaptive(prngs[i].bench, timing, pa, &s);
+            else
+                prngs[i].bench(timing, &s, NSAMPLES);
+            if (i) {
+                timing_correct(s.ns, s.n, nsover);
+                timing_correct(s.cycles, s.n, cyover);
+                if (pa)
+                    s.ci = samples_ci(&s);  /* Relative to the new median */
+            } else {
+                nsover = median(s.ns, s.n);
+                cyover = median(s.cycles, s.n);
+            }
+            report(format, prngs[i].name, !i, &s, pc);
+        }
+        report_end(format);
+        counters_close(&counters);
     }
+    return 0;
 }
@@ -0,0 +1,225 @@
+#ifndef ZIGGURAT_H
+#define ZIGGURAT_H
+
+/* Marsaglia and Tsang's ziggurat method for standard normal and
+ * exponential variates, with 256 layers (Marsaglia and Tsang, "The
+ * Ziggurat Method for Generating Random Variables", 2000). One 64-bit
+ * word supplies everything the common case needs: the low 8 bits pick
+ * the layer, bit 8 is the sign of a normal variate and the high 52 bits
+ * are the position within the layer. Only about 1% of words fall
+ * outside their layer's rectangle and take the slow path.
+ *
+ * The samplers are macros over a rand64(x) that assigns the next raw
+ * word to x, like CONVERT_BOUNDED, so the generator inlines into the
+ * sampling loop. zig_init() must be called once before sampling.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "convert.h"
+
+enum ziggurat {
+    ZIGGURAT_NORMAL,
+    ZIGGURAT_EXPONENTIAL,
+    ZIGGURAT_COUNT
+};
+
+static const char ziggurat_name[ZIGGURAT_COUNT][12] = {
+    "normal", "exp"
+};
+
+#define ZIG_LAYERS 256
+#define ZIG_NR     3.6541528853610088   /* Normal tail start */
+#define ZIG_NV     4.92867323399e-3     /* Normal layer area */
+#define ZIG_ER     7.69711747013104972  /* Exponential tail start */
+#define ZIG_EV     3.949659822581572e-3 /* Exponential layer area */
+
+/* k[i] is the acceptance bound on the 52-bit position in layer i, w[i]
+ * scales that position to a variate, and f[i] is the density at the
+ * layer's upper edge.
+ */
+static struct {
+    uint64_t kn[ZIG_LAYERS];
+    double wn[ZIG_LAYERS];
+    double fn[ZIG_LAYERS];
+    uint64_t ke[ZIG_LAYERS];
+    double we[ZIG_LAYERS];
+    double fe[ZIG_LAYERS];
+} zig;
+
+static void
+zig_init(void)
+{
+    double m = 0x1p52;
+
+    double dn = ZIG_NR, tn = dn;
+    double q = ZIG_NV / exp(-0.5 * dn * dn);
+    zig.kn[0] = dn / q * m;
+    zig.kn[1] = 0;
+    zig.wn[0] = q / m;
+    zig.wn[ZIG_LAYERS - 1] = dn / m;
+    zig.fn[0] = 1;
+    zig.fn[ZIG_LAYERS - 1] = exp(-0.5 * dn * dn);
+    for (int i = ZIG_LAYERS - 2; i >= 1; i--) {
+        dn = sqrt(-2 * log(ZIG_NV / dn + exp(-0.5 * dn * dn)));
+        zig.kn[i + 1] = dn / tn * m;
+        tn = dn;
+        zig.fn[i] = exp(-0.5 * dn * dn);
+        zig.wn[i] = dn / m;
+    }
+
+    double de = ZIG_ER, te = de;
+    q = ZIG_EV / exp(-de);
+    zig.ke[0] = de / q * m;
+    zig.ke[1] = 0;
+    zig.we[0] = q / m;
+    zig.we[ZIG_LAYERS - 1] = de / m;
+    zig.fe[0] = 1;
+    zig.fe[ZIG_LAYERS - 1] = exp(-de);
+    for (int i = ZIG_LAYERS - 2; i >= 1; i--) {
+        de = -log(ZIG_EV / de + exp(-de));
+        zig.ke[i + 1] = de / te * m;
+        te = de;
+        zig.fe[i] = exp(-de);
+        zig.we[i] = de / m;
+    }
+}
+
+/* A uniform in (0, 1], safe to pass to log(). */
+static inline double
+zig_open(uint64_t x)
+{
+    return ((x >> 11) + 1) * 0x1p-53;
+}
+
+/* Give v the sign carried in bit 8 of x. */
+static inline double
+zig_signed(double v, uint64_t x)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    bits ^= (x & 0x100) << 55;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+/* Finish a normal draw from the word already in x: the fast path first,
+ * then the wedge and tail, redrawing until a variate is accepted.
+ */
+#define ZIGGURAT_NORMAL_FIX(rand64, x, dst) \
+    for (;;) { \
+        int l_ = (x) & 0xff; \
+        uint64_t j_ = (x) >> 12; \
+        double v_ = j_ * zig.wn[l_]; \
+        if (j_ < zig.kn[l_]) { \
+            dst = zig_signed(v_, x); \
+            break; \
+        } \
+        uint64_t w_ = (x); \
+        if (!l_) { \
+            double t_, y_; \
+            do { \
+                rand64(x); \
+                t_ = -log(zig_open(x)) / ZIG_NR; \
+                rand64(x); \
+                y_ = -log(zig_open(x)); \
+            } while (y_ + y_ < t_ * t_); \
+            dst = zig_signed(ZIG_NR + t_, w_); \
+            break; \
+        } \
+        rand64(x); \
+        if (zig.fn[l_] + zig_open(x) * (zig.fn[l_ - 1] - zig.fn[l_]) < \
+                exp(-0.5 * v_ * v_)) { \
+            dst = zig_signed(v_, w_); \
+            break; \
+        } \
+        rand64(x); \
+    }
+
+#define ZIGGURAT_EXPONENTIAL_FIX(rand64, x, dst) \
+    for (;;) { \
+        int l_ = (x) & 0xff; \
+        uint64_t j_ = (x) >> 12; \
+        double v_ = j_ * zig.we[l_]; \
+        if (j_ < zig.ke[l_]) { \
+            dst = v_; \
+            break; \
+        } \
+        rand64(x); \
+        if (!l_) { \
+            dst = ZIG_ER - log(zig_open(x)); \
+            break; \
+        } \
+        if (zig.fe[l_] + zig_open(x) * (zig.fe[l_ - 1] - zig.fe[l_]) < \
+                exp(-v_)) { \
+            dst = v_; \
+            break; \
+        } \
+        rand64(x); \
+    }
+
+/* Draw one variate into dst. */
+#define ZIGGURAT_NORMAL(rand64, x, dst) \
+    do { \
+        rand64(x); \
+        ZIGGURAT_NORMAL_FIX(rand64, x, dst) \
+    } while (0)
+
+#define ZIGGURAT_EXPONENTIAL(rand64, x, dst) \
+    do { \
+        rand64(x); \
+        ZIGGURAT_EXPONENTIAL_FIX(rand64, x, dst) \
+    } while (0)
+
+/* Bulk first pass: map every word to its rectangle variate, assuming
+ * the fast path. This has no branches and vectorizes, with the layer
+ * lookups as gathers. The second pass, ZIGGURAT_*_BULK, redoes the few
+ * words that were rejected.
+ */
+static void
+zig_normal_rects(double *out, const uint64_t *in, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        double v = convert_u52(in[i] >> 12) * zig.wn[in[i] & 0xff];
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        bits ^= (in[i] & 0x100) << 55;
+        memcpy(out + i, &bits, sizeof(bits));
+    }
+}
+
+static void
+zig_exponential_rects(double *out, const uint64_t *in, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = convert_u52(in[i] >> 12) * zig.we[in[i] & 0xff];
+}
+
+/* Fill out[] with n variates from the n words in in[], drawing extra
+ * words with rand64 only for rejected positions.
+ */
+#define ZIGGURAT_NORMAL_BULK(rand64, x, out, in, n) \
+    do { \
+        zig_normal_rects(out, in, n); \
+        for (size_t i_ = 0; i_ < (n); i_++) { \
+            if ((in)[i_] >> 12 >= zig.kn[(in)[i_] & 0xff]) { \
+                x = (in)[i_]; \
+                ZIGGURAT_NORMAL_FIX(rand64, x, (out)[i_]) \
+            } \
+        } \
+    } while (0)
+
+#define ZIGGURAT_EXPONENTIAL_BULK(rand64, x, out, in, n) \
+    do { \
+        zig_exponential_rects(out, in, n); \
+        for (size_t i_ = 0; i_ < (n); i_++) { \
+            if ((in)[i_] >> 12 >= zig.ke[(in)[i_] & 0xff]) { \
+                x = (in)[i_]; \
+                ZIGGURAT_EXPONENTIAL_FIX(rand64, x, (out)[i_]) \
+            } \
+        } \
+    } while (0)
+
+#endif